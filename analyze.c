@@ -7,39 +7,93 @@
 /****************************************************/
 
 #include "globals.h"
+#include "intern.h"
 #include "symtab.h"
 #include "analyze.h"
 
 /* counter for variable memory locations */
-static int location = 0;
-char *currentScope = "global";
+static THREAD_LOCAL int location = 0;
 
-/* Procedure traverse is a generic recursive 
- * syntax tree traversal routine:
- * it applies preProc in preorder and postProc 
- * in postorder to tree pointed to by t
+/* a check found while the symbol table is built
+ * and reported after it: a type error with its
+ * message, or, if message is NULL, a call whose
+ * function may be declared later in the program
  */
-static void traverse( TreeNode * t,
-               void (* preProc) (TreeNode *),
-               void (* postProc) (TreeNode *) )
-{ if (t != NULL)
-  { preProc(t);
-    { int i;
-      for (i=0; i < MAXCHILDREN; i++)
-        traverse(t->child[i],preProc,postProc);
-    }
-    postProc(t);
-    traverse(t->sibling,preProc,postProc);
+typedef struct
+   { TreeNode * node;
+     char * message;
+   } Check;
+
+typedef struct
+   { Check * checks;
+     int count;
+     int size;
+   } CheckList;
+
+/* the checks of the program */
+static THREAD_LOCAL CheckList program;
+
+/* the analysis of a top-level declaration whose
+ * function body is analyzed apart, maybe on
+ * another thread, then merged in source order
+ */
+struct AnalysisRec
+   { TreeNode * t;
+     int unit;
+     int location;  /* location after its head */
+     int locations; /* locations its body takes */
+     Symbol * relocs; /* symbols placed from location */
+     int relocCount;
+     int relocSize;
+     StUnit head;
+     StUnit body;
+     CheckList checks;
+     char * messages; /* its semantic errors */
+     size_t messageSize;
+     FILE * messageFile;
+     int errors;
+     int headChecks;     /* the checks, message bytes */
+     size_t headSize;    /* and errors of its head */
+     int headErrors;
+   };
+
+/* the analysis this thread is doing, or NULL */
+static THREAD_LOCAL Analysis current = NULL;
+
+/* locations taken by the bodies merged so far */
+static THREAD_LOCAL int shift = 0;
+
+static void * growList(void * p, int * size, int width)
+{ *size = *size ? 2 * *size : 256;
+  p = realloc(p, (size_t) *size * width);
+  if (p == NULL)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    exit(1);
   }
+  return p;
+}
+
+static void deferCheck(TreeNode * t, char * message)
+{ CheckList * l = current != NULL ? &current->checks : &program;
+  if (l->count == l->size)
+    l->checks = (Check *) growList(l->checks, &l->size, sizeof(Check));
+  l->checks[l->count].node = t;
+  l->checks[l->count].message = message;
+  l->count++;
 }
 
-/* nullProc is a do-nothing procedure to 
- * generate preorder-only or postorder-only
- * traversals from traverse
+/* Function declareAt declares the identifier of
+ * t at memory location loc, which a split analysis
+ * moves by the locations of the bodies before it
  */
-static void nullProc(TreeNode * t)
-{ if (t==NULL) return;
-  else return;
+static Symbol declareAt(TreeNode * t, int loc)
+{ Symbol s = st_declare(t->attr.name,t->lineno,loc,t->decl,t->type);
+  if (current != NULL)
+  { if (current->relocCount == current->relocSize)
+      current->relocs = (Symbol *) growList(current->relocs, &current->relocSize, sizeof(Symbol));
+    current->relocs[current->relocCount++] = s;
+  }
+  return s;
 }
 
 /* Procedure insertNode inserts 
@@ -76,8 +130,16 @@ static void insertDecl( TreeNode * t)
 }
 
 static void semanticError(TreeNode * t, char * message)
-{ fprintf(listing,"Erro semantico na linha %d: %s\n",t->lineno,message);
-  Error = TRUE;
+{ FILE * f = listing;
+  if (current != NULL)
+  { /* kept for analyzeMerge */
+    if (current->messageFile == NULL)
+      current->messageFile = open_memstream(&current->messages, &current->messageSize);
+    f = current->messageFile;
+    current->errors++;
+  }
+  else Error++;
+  fprintf(f,"Erro semantico na linha %d: %s\n",t->lineno,message);
 }
 
 static void insertType( TreeNode * t)
@@ -85,9 +147,9 @@ static void insertType( TreeNode * t)
   { case StmtK:
       switch (t->kind.stmt){
         case TypeK:
-          if (strcmp(t->attr.name, "void") == 0) {
+          if (t->attr.name == nameVoid) {
             t->child[0]->type = Void;
-          } else if (strcmp(t->attr.name, "int") == 0) {
+          } else if (t->attr.name == nameInt) {
             t->child[0]->type = Integer;
           }
           break;
@@ -111,73 +173,66 @@ static void insertNode( TreeNode * t)
   { case StmtK:
       switch (t->kind.stmt)
       { 
-        int varIsNotGlobal, varIsNotOnCurrentScope;
+        Symbol visible, global, local;
         case AssignK:
-          varIsNotGlobal = st_lookup(t->attr.name, "global");
-          varIsNotOnCurrentScope = st_lookup(t->attr.name, currentScope);
+          visible = st_find(t->attr.name, ST_VISIBLE);
 
-          if(t->child[1]->kind.stmt == ActivK && !(strcmp(t->child[1]->attr.name, "input") == 0 || strcmp(t->child[1]->attr.name, "output") == 0)) { 
+          if(t->child[1]->kind.stmt == ActivK && !(t->child[1]->attr.name == nameInput || t->child[1]->attr.name == nameOutput)) { 
             if (t->child[1]->type != t->type) {
               semanticError(t, "atribuição inválida");
             }
           }
 
-          if (varIsNotOnCurrentScope == -1 && varIsNotGlobal == -1) {
+          if (visible == NULL) {
             semanticError(t, "variável não declarada");
+            /* not yet in table, so treat as new definition */
+            visible = declareAt(t, location);
           }
-          if (varIsNotGlobal != -1) {
-            st_insert(t->attr.name,t->lineno,location++,t->decl,t->type, "global");
-          }
-          else {
-            st_insert(t->attr.name,t->lineno,location++,t->decl,t->type, currentScope);
-          }
+          else st_addLine(visible, t->lineno);
+          location++;
           break;
         case VarDeclK:
-          varIsNotGlobal = st_lookup(t->attr.name, "global");
-          varIsNotOnCurrentScope = st_lookup(t->attr.name, currentScope);
-          if (varIsNotOnCurrentScope == -1 && varIsNotGlobal == -1) {
+          visible = st_find(t->attr.name, ST_VISIBLE);
+          global = st_select(visible, ST_GLOBAL);
+          local = st_select(visible, ST_LOCAL);
+          if (local == NULL && global == NULL) {
             /* not yet in table, so treat as new definition */
-            st_insert(t->attr.name,t->lineno,location++,t->decl,t->type, currentScope);
+            declareAt(t, location++);
           }
           else {
-            int var_decl_current_scope = st_lookup_decl(t->attr.name, currentScope);
-            int var_decl_global_scope = st_lookup_decl(t->attr.name, "global");
             /* already in table, so ignore location, 
              add line number of use only */ 
-            if ((varIsNotGlobal != -1 && (var_decl_global_scope == t->decl)) || 
-              (varIsNotOnCurrentScope != -1 && (var_decl_current_scope == t->decl))) {
+            if ((global != NULL && st_decl(global) == t->decl) || 
+              (local != NULL && st_decl(local) == t->decl)) {
               semanticError(t, "variavel ja declarada anteriormente");
-              st_insert(t->attr.name,t->lineno,0,t->decl,t->type, currentScope);
             } else {
               semanticError(t, "declaracao inválida");
-              st_insert(t->attr.name,t->lineno,0,t->decl,t->type, currentScope);
             }
+            st_declare(t->attr.name,t->lineno,0,t->decl,t->type);
           }
           break;
         case FuncDeclK:
-          if (st_lookup(t->attr.name, currentScope) == -1){
+          if (st_find(t->attr.name, ST_LOCAL) == NULL){
             /* not yet in table, so treat as new definition */
-            st_insert(t->attr.name,t->lineno,location++,t->decl,t->type, "global");
-            currentScope = t->attr.name;
+            declareAt(t, location++);
           }
           else {
             /* already in table, so ignore location, 
              add line number of use only */ 
             semanticError(t, "funcao ja declarada anteriormente");
-            st_insert(t->attr.name,t->lineno,0,t->decl, t->type, "global");
+            st_declare(t->attr.name,t->lineno,0,t->decl, t->type);
           }
-
           break;
         case ArrDeclK:
-          if (st_lookup(t->attr.name, currentScope) == -1){
+          if (st_find(t->attr.name, ST_LOCAL) == NULL){
             /* not yet in table, so treat as new definition */
-            st_insert(t->attr.name,t->lineno,location++,t->decl,t->type, currentScope);
+            declareAt(t, location++);
           }
           else{
             /* already in table, so ignore location, 
              add line number of use only */ 
             semanticError(t, "variavel ja declarada anteriormente");
-            st_insert(t->attr.name,t->lineno,0,t->decl,t->type, currentScope);
+            st_declare(t->attr.name,t->lineno,0,t->decl,t->type);
           }
           break;
         case IfK:
@@ -223,6 +278,8 @@ static void insertNode( TreeNode * t)
           // st_insert("ConstK",t->lineno,location++,t->decl,t->type, currentScope);
           break;
         case IdK:
+          /* looked up only for the cross-reference index */
+          st_addUseOf(t->attr.name, t->lineno);
           // variavel usada sem ser a declaracao
           // fprintf(listing, "\n nome: %s linha: %d decl: %s type: %s scope:%s",t->attr.name, t->lineno,convertDeclToMessage(t->decl),convertTypeToMessage(t->type), currentScope);
           // st_insert("IdK",t->lineno,location++,t->decl,t->type, currentScope);
@@ -236,26 +293,131 @@ static void insertNode( TreeNode * t)
   }
 }
 
+static void checkNode(TreeNode * t);
+
+/* Function isBlock tells whether child i of t is
+ * a statement with a scope of its own: the
+ * branches of an if and the body of a while
+ */
+static int isBlock(TreeNode * t, int i)
+{ if (t->nodekind != StmtK) return FALSE;
+  switch (t->kind.stmt)
+  { case IfK: return i == 1 || i == 2;
+    case RepeatK: return i == 1;
+    default: return FALSE;
+  }
+}
+
+static void analyzeTree(TreeNode * t);
+
+static int isFunction(TreeNode * t)
+{ return t != NULL && t->nodekind == StmtK && t->kind.stmt == FuncDeclK;
+}
+
+/* Procedure analyzeChildren analyzes the children
+ * of t, each block in a scope of its own
+ */
+static void analyzeChildren(TreeNode * t)
+{ int i;
+  for (i=0; i < MAXCHILDREN; i++)
+  { int block = isBlock(t, i);
+    if (block) st_enterScope(NULL);
+    analyzeTree(t->child[i]);
+    if (block) st_exitScope();
+  }
+}
+
+/* Procedure analyzeNode analyzes the tree t,
+ * without its siblings: in preorder t is given
+ * its decl and type and its identifier is entered
+ * into the symbol table, in postorder it is type
+ * checked. A function opens a scope around its
+ * children.
+ */
+static void analyzeNode(TreeNode * t)
+{ insertDecl(t);
+  insertType(t);
+  insertNode(t);
+  if (isFunction(t)) st_enterScope(t->attr.name);
+  analyzeChildren(t);
+  if (isFunction(t)) st_exitScope();
+  checkNode(t);
+}
+
+/* Procedure analyzeTree analyzes the tree t in a
+ * single walk. It recurses on children only and
+ * loops over siblings, so the stack grows with the
+ * nesting depth, not with the length of a list.
+ */
+static void analyzeTree(TreeNode * t)
+{ while (t != NULL)
+  { analyzeNode(t);
+    t = t->sibling;
+  }
+}
+
 /* Function buildSymtab constructs the symbol 
- * table by preorder traversal of the syntax tree
+ * table by preorder traversal of the syntax tree;
+ * the type checks are made in the same traversal
+ * and kept for typeCheck
  */
 void buildSymtab(TreeNode * syntaxTree)
-{ 
-  traverse(syntaxTree,insertDecl,nullProc);
-  traverse(syntaxTree,insertType,nullProc);
-  traverse(syntaxTree,insertNode,nullProc);
-  //traverse(syntaxTree,insertScope,nullProc);
-  if (TraceAnalyze)
-  { 
-    printErrors(listing);
-    fprintf(listing,"\nSymbol table:\n\n");
-    printSymTab(listing);
-  }
+{ startAnalysis();
+  analyzeTree(syntaxTree);
+  if (TraceAnalyze) listSymtab();
 }
 
-static void typeError(TreeNode * t, char * message)
+/* Procedure listSymtab prints the semantic errors
+ * and the symbol table to the listing file
+ */
+void listSymtab(void)
+{ printErrors(listing);
+  fprintf(listing,"\nSymbol table:\n\n");
+  printSymTab(listing);
+}
+
+/* Procedure startAnalysis prepares the
+ * analysis of a new program
+ */
+void startAnalysis(void)
+{ location = 0;
+  shift = 0;
+  program.count = 0;
+}
+
+static void reportTypeError(TreeNode * t, char * message)
 { fprintf(listing,"Type error at line %d: %s\n",t->lineno,message);
-  Error = TRUE;
+  Error++;
+}
+
+static void typeError(TreeNode * t, char * message)
+{ deferCheck(t, message);
+}
+
+/* Procedure checkCall reports a call of a
+ * function that has not been declared
+ */
+static void checkCall(TreeNode * t)
+{ Symbol s = st_find(t->attr.name, ST_VISIBLE);
+  if (s != NULL) st_addUse(s, t->lineno);
+  if (s == NULL) {
+    if (t->attr.name == nameInput || t->attr.name == nameOutput) {
+      return;
+    }
+    reportTypeError(t, "chamada de função não declarada");
+  }
+}
+
+/* Procedure reportChecks reports the checks
+ * found so far, in the order they were found
+ */
+static void reportChecks(void)
+{ int i;
+  for (i = 0; i < program.count; i++)
+    if (program.checks[i].message != NULL)
+      reportTypeError(program.checks[i].node, program.checks[i].message);
+    else checkCall(program.checks[i].node);
+  program.count = 0;
 }
 
 /* Procedure checkNode performs
@@ -306,15 +468,11 @@ static void checkNode(TreeNode * t)
             typeError(t->child[1],"repeat test is not Boolean");
           break;
         case ActivK:
-          if (st_lookup(t->attr.name, currentScope) == -1 && st_lookup(t->attr.name, "global") == -1) {
-            if (strcmp(t->attr.name, "input") == 0 || strcmp(t->attr.name, "output") == 0) {
-              break;
-            }
-            typeError(t, "chamada de função não declarada");
-          }
+          /* checked by typeCheck, once every function is declared */
+          deferCheck(t, NULL);
           break;
         case TypeK:
-          if (strcmp(t->attr.name, "void") == 0 && t->child[0]->decl == 1) {
+          if (t->attr.name == nameVoid && t->child[0]->decl == 1) {
             typeError(t, "declaracao invalida de variavel");
           }
           break;
@@ -329,9 +487,185 @@ static void checkNode(TreeNode * t)
   }
 }
 
-/* Procedure typeCheck performs type checking 
- * by a postorder syntax tree traversal
+/* Procedure typeCheck reports the type errors
+ * buildSymtab found in syntaxTree, in postorder,
+ * and checks its calls now that every function
+ * is declared
  */
 void typeCheck(TreeNode * syntaxTree)
-{ traverse(syntaxTree,nullProc,checkNode);
+{ (void) syntaxTree;
+  reportChecks();
+  free(program.checks);
+  program.checks = NULL;
+  program.count = program.size = 0;
+}
+
+/* Procedure analyzeDecl enters the symbols of a
+ * single top-level declaration t into the symbol
+ * table and type checks it; the declarations
+ * before it must already have been analyzed.
+ * Unlike typeCheck after buildSymtab, a call is
+ * checked before later functions are declared.
+ */
+void analyzeDecl(TreeNode * t)
+{ analyzeTree(t);
+  reportChecks();
+}
+
+/* Function analyzeHead analyzes the top-level
+ * declaration t, number unit in the program, but
+ * for the body of a function, which analyzeBody
+ * analyzes later. The heads of the declarations
+ * before t must already have been analyzed.
+ */
+Analysis analyzeHead(TreeNode * t, int unit)
+{ Analysis a = (Analysis) calloc(1, sizeof(struct AnalysisRec));
+  if (a == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  a->t = t;
+  a->unit = unit;
+  current = a;
+  st_beginUnit(unit);
+  if (isFunction(t->child[0]))
+  { /* the type and the function, in preorder */
+    insertDecl(t);
+    insertType(t);
+    insertNode(t);
+    insertDecl(t->child[0]);
+    insertType(t->child[0]);
+    insertNode(t->child[0]);
+  }
+  else analyzeNode(t);
+  a->head = st_endUnit();
+  a->location = location;
+  a->headChecks = a->checks.count;
+  if (a->messageFile != NULL) fflush(a->messageFile);
+  a->headSize = a->messageSize;
+  a->headErrors = a->errors;
+  current = NULL;
+  return a;
+}
+
+/* Procedure analyzeBody analyzes the body of the
+ * function declared by a, if any, in the symbol
+ * table of this thread. The global scope must have
+ * been published after the heads of all the
+ * top-level declarations were analyzed.
+ */
+void analyzeBody(Analysis a)
+{ TreeNode * f = a->t->child[0];
+  if (!isFunction(f)) return;
+  current = a;
+  location = a->location;
+  st_beginUnit(a->unit);
+  st_enterScope(f->attr.name);
+  analyzeChildren(f);
+  st_exitScope();
+  checkNode(f);
+  checkNode(a->t);
+  a->body = st_endUnit();
+  a->locations = location - a->location;
+  current = NULL;
+}
+
+/* Procedure analyzeMerge enters the symbols of a
+ * into the symbol table of the compiler, moved by
+ * the locations of the bodies merged before it,
+ * and reports its semantic errors; its checks are
+ * left for typeCheck. Merging the analyses in the
+ * order of their units gives the symbol table, the
+ * listing and the checks of buildSymtab. a is freed.
+ */
+void analyzeMerge(Analysis a)
+{ int i;
+  for (i = 0; i < a->relocCount; i++)
+    st_setMemloc(a->relocs[i], st_memloc(a->relocs[i]) + shift);
+  shift += a->locations;
+  st_addUnit(a->head);
+  if (a->body != NULL) st_addUnit(a->body);
+  if (a->messageFile != NULL)
+  { fclose(a->messageFile);
+    fwrite(a->messages, 1, a->messageSize, listing);
+    free(a->messages);
+  }
+  Error += a->errors;
+  for (i = 0; i < a->checks.count; i++)
+    deferCheck(a->checks.checks[i].node, a->checks.checks[i].message);
+  free(a->checks.checks);
+  free(a->relocs);
+  free(a);
+}
+
+/* Function analyzeKeep returns what analyzeBody
+ * found in the body of a: its semantic errors and
+ * its checks, which refer to the nodes of its tree
+ */
+Analysis analyzeKeep(Analysis a)
+{ Analysis k = (Analysis) calloc(1, sizeof(struct AnalysisRec));
+  int n = a->checks.count - a->headChecks;
+  if (k == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  k->t = a->t;
+  k->unit = a->unit;
+  if (a->messageFile != NULL) fflush(a->messageFile);
+  k->messageSize = a->messageSize - a->headSize;
+  if (k->messageSize > 0)
+  { k->messages = (char *) malloc(k->messageSize);
+    if (k->messages == NULL)
+    { fprintf(listing,"Out of memory error\n");
+      exit(1);
+    }
+    memcpy(k->messages, a->messages + a->headSize, k->messageSize);
+  }
+  while (k->checks.size < n)
+    k->checks.checks = (Check *) growList(k->checks.checks, &k->checks.size, sizeof(Check));
+  if (n > 0) memcpy(k->checks.checks, a->checks.checks + a->headChecks, n * sizeof(Check));
+  k->checks.count = n;
+  k->errors = a->errors - a->headErrors;
+  return k;
+}
+
+/* Procedure analyzeReuse gives the analysis a of
+ * a top-level declaration what analyzeKeep kept
+ * from the analysis of its body in an earlier
+ * compilation, in place of analyzeBody. The body
+ * must not have changed, nor the declarations it
+ * refers to, and if it had semantic errors, the
+ * lines they give must not have moved.
+ */
+void analyzeReuse(Analysis a, Analysis kept)
+{ int i;
+  if (kept->messageSize > 0)
+  { if (a->messageFile == NULL)
+      a->messageFile = open_memstream(&a->messages, &a->messageSize);
+    fwrite(kept->messages, 1, kept->messageSize, a->messageFile);
+  }
+  a->errors += kept->errors;
+  for (i = 0; i < kept->checks.count; i++)
+  { Check * c = &kept->checks.checks[i];
+    if (a->checks.count == a->checks.size)
+      a->checks.checks = (Check *) growList(a->checks.checks, &a->checks.size, sizeof(Check));
+    a->checks.checks[a->checks.count++] = *c;
+  }
+}
+
+/* Function analyzeErrors returns the number of
+ * semantic errors found by the analysis a
+ */
+int analyzeErrors(Analysis a)
+{ return a->errors;
+}
+
+/* Procedure analyzeFree frees an analysis kept
+ * by analyzeKeep
+ */
+void analyzeFree(Analysis kept)
+{ if (kept == NULL) return;
+  free(kept->messages);
+  free(kept->checks.checks);
+  free(kept);
 }
@@ -9,13 +9,69 @@
 #define _ANALYZE_H_
 
 /* Function buildSymtab constructs the symbol 
- * table by preorder traversal of the syntax tree
+ * table and type checks the syntax tree in a
+ * single traversal
  */
 void buildSymtab(TreeNode *);
 
-/* Procedure typeCheck performs type checking 
- * by a postorder syntax tree traversal
+/* Procedure typeCheck reports the type errors
+ * found by buildSymtab and checks the calls
  */
 void typeCheck(TreeNode *);
 
+/* Procedure startAnalysis prepares the
+ * analysis of a new program
+ */
+void startAnalysis(void);
+
+/* Procedure analyzeDecl enters the symbols of a
+ * single top-level declaration t into the symbol
+ * table and type checks it; the declarations
+ * before it must already have been analyzed
+ */
+void analyzeDecl(TreeNode * t);
+
+/* the analysis of a top-level declaration whose
+ * function body is analyzed apart
+ */
+typedef struct AnalysisRec * Analysis;
+
+/* To analyze the functions of a program at once,
+ * analyzeHead analyzes each top-level declaration
+ * t, number unit in the program, in order, but for
+ * the body of a function. Once the global scope is
+ * published (see st_publish), analyzeBody analyzes
+ * the bodies, on any threads with symbol tables of
+ * their own. analyzeMerge then merges the analyses
+ * in order into the symbol table and the checks
+ * that buildSymtab would have left, reports their
+ * semantic errors and frees them.
+ */
+Analysis analyzeHead(TreeNode * t, int unit);
+void analyzeBody(Analysis a);
+void analyzeMerge(Analysis a);
+
+/* To analyze a program again after some of its
+ * top-level declarations changed, analyzeKeep
+ * returns what analyzeBody found in the body of a,
+ * its semantic errors and checks, before a is
+ * merged. In the next analysis, analyzeReuse gives
+ * it to the analysis of the same declaration in
+ * place of analyzeBody, as long as neither the
+ * body nor the declarations it refers to changed
+ * and its semantic errors, whose messages give
+ * their lines, did not move. analyzeErrors returns
+ * the number of semantic errors of an analysis and
+ * analyzeFree frees a kept one.
+ */
+Analysis analyzeKeep(Analysis a);
+void analyzeReuse(Analysis a, Analysis kept);
+int analyzeErrors(Analysis a);
+void analyzeFree(Analysis kept);
+
+/* Procedure listSymtab prints the semantic errors
+ * and the symbol table to the listing file
+ */
+void listSymtab(void);
+
 #endif
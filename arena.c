@@ -0,0 +1,109 @@
+/****************************************************/
+/* File: arena.c                                    */
+/* Arena allocator implementation for the CMINUS    */
+/* compiler                                         */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <stddef.h>
+#include <pthread.h>
+#include "arena.h"
+
+/* BLOCKSIZE is the usual size of a block; larger
+ * objects get a block of their own
+ */
+#define BLOCKSIZE (256 * 1024)
+
+/* ALIGN is the alignment of every allocation */
+#define ALIGN 16
+
+struct arenaBlock
+   { struct arenaBlock * next;
+     size_t size;  /* bytes of data */
+     long double data[1]; /* aligned start of the data */
+   };
+
+THREAD_LOCAL Arena * currentArena;
+
+/* released blocks, shared by the arenas of all
+ * threads and reused before new ones are made
+ */
+static ArenaBlock * freeBlocks;
+static pthread_mutex_t freeLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Function newBlock returns a block with room
+ * for at least n bytes, reusing the most recently
+ * released block if it is large enough
+ */
+static ArenaBlock * newBlock(size_t n)
+{ ArenaBlock * b;
+  size_t size = n > BLOCKSIZE ? n : BLOCKSIZE;
+  pthread_mutex_lock(&freeLock);
+  b = freeBlocks;
+  if (b != NULL && b->size >= n) freeBlocks = b->next;
+  else b = NULL;
+  pthread_mutex_unlock(&freeLock);
+  if (b == NULL)
+  { b = (ArenaBlock *) malloc(offsetof(ArenaBlock, data) + size);
+    if (b == NULL)
+    { fprintf(listing,"Out of memory error at line %d\n",lineno);
+      exit(1);
+    }
+    b->size = size;
+  }
+  b->next = NULL;
+  return b;
+}
+
+/* Function arenaAlloc returns n bytes from arena a,
+ * aligned for any object
+ */
+void * arenaAlloc(Arena * a, size_t n)
+{ char * p;
+  n = (n + ALIGN - 1) & ~(size_t) (ALIGN - 1);
+  if (n > (size_t) (a->limit - a->next))
+  { ArenaBlock * b = newBlock(n);
+    if (a->last == NULL) a->first = b;
+    else a->last->next = b;
+    a->last = b;
+    a->next = (char *) b->data;
+    a->limit = a->next + b->size;
+  }
+  p = a->next;
+  a->next += n;
+  a->bytes += n;
+  return p;
+}
+
+/* Procedure arenaJoin moves the blocks of arena
+ * from to the end of arena into in constant time;
+ * from is left empty. Allocation goes on in the
+ * last block joined.
+ */
+void arenaJoin(Arena * into, Arena * from)
+{ if (from->first == NULL) return;
+  if (into->last == NULL) into->first = from->first;
+  else into->last->next = from->first;
+  into->last = from->last;
+  into->next = from->next;
+  into->limit = from->limit;
+  into->bytes += from->bytes;
+  into->nodes += from->nodes;
+  memset(from, 0, sizeof(Arena));
+}
+
+/* Procedure arenaRelease frees everything allocated
+ * from arena a in constant time, by putting its whole
+ * chain of blocks on the list of released blocks
+ */
+void arenaRelease(Arena * a)
+{ if (a->first != NULL)
+  { pthread_mutex_lock(&freeLock);
+    a->last->next = freeBlocks;
+    freeBlocks = a->first;
+    pthread_mutex_unlock(&freeLock);
+  }
+  memset(a, 0, sizeof(Arena));
+}
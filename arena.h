@@ -0,0 +1,52 @@
+/****************************************************/
+/* File: arena.h                                    */
+/* Arena allocator for the CMINUS compiler          */
+/* Syntax tree nodes, strings and symbol table      */
+/* records of a compilation are carved from the     */
+/* blocks of an arena and released all at once      */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+typedef struct arenaBlock ArenaBlock;
+
+/* an arena is a chain of blocks; allocation bumps
+ * a pointer in the last block. The all-zero arena
+ * is empty and ready for use.
+ */
+typedef struct
+   { ArenaBlock * first; /* chain of blocks, oldest first */
+     ArenaBlock * last;  /* block allocations come from */
+     char * next;        /* first free byte of last */
+     char * limit;       /* end of last */
+     long bytes;         /* bytes allocated from the arena */
+     long nodes;         /* syntax tree nodes among them */
+   } Arena;
+
+/* currentArena is the arena the compiler allocates
+ * from on this thread; it must be set before parsing
+ */
+extern THREAD_LOCAL Arena * currentArena;
+
+/* Function arenaAlloc returns n bytes from arena a,
+ * aligned for any object
+ */
+void * arenaAlloc(Arena * a, size_t n);
+
+/* Procedure arenaJoin moves the blocks of arena
+ * from to the end of arena into in constant time;
+ * from is left empty
+ */
+void arenaJoin(Arena * into, Arena * from);
+
+/* Procedure arenaRelease frees everything allocated
+ * from arena a in constant time. The blocks are kept
+ * for later arenas, so that compiling many units
+ * does not grow the process.
+ */
+void arenaRelease(Arena * a);
+
+#endif
@@ -0,0 +1,177 @@
+/****************************************************/
+/* File: ast.c                                      */
+/* Compact syntax tree store implementation for     */
+/* the CMINUS compiler                              */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "intern.h"
+#include "ast.h"
+
+static void outOfMemory(void)
+{ fprintf(listing,"Out of memory error at line %d\n",lineno);
+  exit(1);
+}
+
+/* Procedure growTree doubles the capacity
+ * of every array of the store
+ */
+static void growTree(FlatTree * f)
+{ int cap = f->capacity ? f->capacity * 2 : 1024;
+  f->kind = realloc(f->kind, cap);
+  f->slot = realloc(f->slot, cap);
+  f->type = realloc(f->type, cap);
+  f->attr = realloc(f->attr, cap * sizeof(int));
+  f->child = realloc(f->child, cap * sizeof(NodeId));
+  f->next = realloc(f->next, cap * sizeof(NodeId));
+  f->line = realloc(f->line, cap * sizeof(int));
+  if (!f->kind || !f->slot || !f->type || !f->attr ||
+      !f->child || !f->next || !f->line)
+    outOfMemory();
+  f->capacity = cap;
+}
+
+/* Function nameId returns the id of an interned
+ * name in f, giving it the next id if it is new
+ */
+static int nameId(FlatTree * f, char * name)
+{ int h;
+  if (2 * (f->names + 1) > f->idSize)
+  { int size = f->idSize ? f->idSize * 2 : 256;
+    char ** n = (char **) calloc(size, sizeof(char *));
+    int * id = (int *) malloc(size * sizeof(int));
+    int i;
+    if (n == NULL || id == NULL) outOfMemory();
+    for (i = 0; i < f->idSize; i++)
+      if (f->idName[i] != NULL)
+      { h = (int) (nameHash(f->idName[i]) & (size - 1));
+        while (n[h] != NULL) h = (h + 1) & (size - 1);
+        n[h] = f->idName[i];
+        id[h] = f->idOf[i];
+      }
+    free(f->idName);
+    free(f->idOf);
+    f->idName = n;
+    f->idOf = id;
+    f->idSize = size;
+    f->name = realloc(f->name, (size / 2) * sizeof(char *));
+    if (f->name == NULL) outOfMemory();
+  }
+  h = (int) (nameHash(name) & (f->idSize - 1));
+  while (f->idName[h] != NULL)
+  { if (f->idName[h] == name) return f->idOf[h];
+    h = (h + 1) & (f->idSize - 1);
+  }
+  f->idName[h] = name;
+  f->idOf[h] = f->names;
+  f->name[f->names] = name;
+  return f->names++;
+}
+
+/* Function hasName tells whether attr of t
+ * holds a name
+ */
+static int hasName(TreeNode * t)
+{ if (t->nodekind == ExpK) return t->kind.exp == IdK;
+  switch (t->kind.stmt)
+  { case IfK:
+    case RepeatK:
+    case RetK:
+      return FALSE;
+    default:
+      return TRUE;
+  }
+}
+
+/* Function flattenList stores the sibling chain t,
+ * with its subtrees, in preorder, and returns the
+ * id of its first node; *last is set to the id of
+ * its last node
+ */
+static NodeId flattenList(FlatTree * f, TreeNode * t, int slot, NodeId * last)
+{ NodeId first = NONE, prev = NONE;
+  while (t != NULL)
+  { NodeId n = f->count;
+    NodeId tail = NONE;
+    int i;
+    if (f->count == f->capacity) growTree(f);
+    f->count++;
+    f->kind[n] = t->nodekind == StmtK ? t->kind.stmt : FLATEXP + t->kind.exp;
+    f->slot[n] = slot;
+    f->type[n] = t->type;
+    f->line[n] = t->lineno;
+    if (hasName(t)) f->attr[n] = t->attr.name != NULL ? nameId(f, t->attr.name) : NONE;
+    else if (t->nodekind == ExpK && t->kind.exp == ConstK) f->attr[n] = t->attr.val;
+    else f->attr[n] = t->attr.op;
+    f->child[n] = NONE;
+    f->next[n] = NONE;
+    for (i = 0; i < MAXCHILDREN; i++)
+    { NodeId l;
+      NodeId c = flattenList(f, t->child[i], i, &l);
+      if (c == NONE) continue;
+      if (tail == NONE) f->child[n] = c;
+      else f->next[tail] = c;
+      tail = l;
+    }
+    if (prev == NONE) first = n;
+    else f->next[prev] = n;
+    prev = n;
+    t = t->sibling;
+  }
+  *last = prev;
+  return first;
+}
+
+/* Function flattenTree builds the compact store
+ * of the syntax tree t; the tree is not changed.
+ * The store holds all its state, so trees can be
+ * flattened on several threads at once
+ */
+FlatTree * flattenTree(TreeNode * t)
+{ FlatTree * f = (FlatTree *) calloc(1, sizeof(FlatTree));
+  NodeId last;
+  if (f == NULL) outOfMemory();
+  f->root = flattenList(f, t, 0, &last);
+  return f;
+}
+
+/* Procedure flatTraverse applies preProc in
+ * preorder and postProc in postorder to node n
+ * of tree f and the nodes following it
+ */
+void flatTraverse(FlatTree * f, NodeId n,
+                  void (* preProc) (FlatTree *, NodeId),
+                  void (* postProc) (FlatTree *, NodeId))
+{ while (n != NONE)
+  { preProc(f, n);
+    flatTraverse(f, f->child[n], preProc, postProc);
+    postProc(f, n);
+    n = f->next[n];
+  }
+}
+
+/* Function flatBytes returns the number of
+ * bytes the arrays of f take per node
+ */
+int flatBytes(void)
+{ return 3 * sizeof(unsigned char) + sizeof(int) +
+         2 * sizeof(NodeId) + sizeof(int);
+}
+
+/* Procedure freeFlatTree releases the store */
+void freeFlatTree(FlatTree * f)
+{ if (f == NULL) return;
+  free(f->kind);
+  free(f->slot);
+  free(f->type);
+  free(f->attr);
+  free(f->child);
+  free(f->next);
+  free(f->line);
+  free(f->name);
+  free(f->idName);
+  free(f->idOf);
+  free(f);
+}
@@ -0,0 +1,73 @@
+/****************************************************/
+/* File: ast.h                                      */
+/* Compact syntax tree store for the CMINUS         */
+/* compiler: nodes are 32-bit indices into          */
+/* parallel arrays instead of TreeNode records      */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _AST_H_
+#define _AST_H_
+
+/* NodeId is the index of a node in a FlatTree;
+ * NONE stands for no node
+ */
+typedef int NodeId;
+#define NONE (-1)
+
+/* FLATEXP is added to an ExpKind to give the
+ * kind of an expression node; statement nodes
+ * keep their StmtKind
+ */
+#define FLATEXP 16
+
+/* Node i of the tree is described by the i-th
+ * entry of each array. Nodes are stored in
+ * preorder. The children of a node are chained
+ * through next, each tagged with the child slot
+ * of the TreeNode it came from; the siblings of
+ * a TreeNode follow it in the same slot.
+ */
+typedef struct
+   { int count;             /* number of nodes */
+     int capacity;          /* allocated entries per array */
+     unsigned char * kind;  /* StmtKind or FLATEXP + ExpKind */
+     unsigned char * slot;  /* child slot in the parent */
+     unsigned char * type;  /* ExpType */
+     int * attr;            /* op, val or name id */
+     NodeId * child;        /* first child */
+     NodeId * next;         /* next child of the same parent */
+     int * line;            /* source line */
+     int names;             /* number of distinct names */
+     char ** name;          /* interned name of each name id */
+     char ** idName;        /* open addressing table of the */
+     int * idOf;            /* names and their ids, keyed on */
+     int idSize;            /* the interned name */
+     NodeId root;           /* first top-level declaration */
+   } FlatTree;
+
+/* Function flattenTree builds the compact store
+ * of the syntax tree t; the tree is not changed.
+ * The store holds all its state, so trees can be
+ * flattened on several threads at once
+ */
+FlatTree * flattenTree(TreeNode * t);
+
+/* Procedure flatTraverse applies preProc in
+ * preorder and postProc in postorder to node n
+ * of tree f and the nodes following it
+ */
+void flatTraverse(FlatTree * f, NodeId n,
+                  void (* preProc) (FlatTree *, NodeId),
+                  void (* postProc) (FlatTree *, NodeId));
+
+/* Function flatBytes returns the number of
+ * bytes the arrays of f take per node
+ */
+int flatBytes(void);
+
+/* Procedure freeFlatTree releases the store */
+void freeFlatTree(FlatTree * f);
+
+#endif
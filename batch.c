@@ -0,0 +1,276 @@
+/****************************************************/
+/* File: batch.c                                    */
+/* Compilation of many source files on a pool of    */
+/* threads for the CMINUS compiler                  */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "compiler.h"
+#include "batch.h"
+
+/* a source file of the batch and what became of it */
+typedef struct
+   { char * path;
+     char * base;  /* outdir/name without its extension */
+     double ms;    /* time to read, compile and write it */
+     int errors;   /* errors of the compilation */
+     int failed;   /* TRUE if it could not be read or written */
+   } Job;
+
+static Job * jobList;
+static int jobCount;
+static int jobSize;
+static atomic_int nextJob;
+static char * outDir;
+static int options;
+
+static char * joinPath(const char * dir, const char * name)
+{ char * p = (char *) malloc(strlen(dir) + strlen(name) + 2);
+  if (p == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  sprintf(p, "%s/%s", dir, name);
+  return p;
+}
+
+int commandOptions(void)
+{ return (HashCons ? CM_HASH_CONS : 0) | (TraceAnalyze ? CM_TRACE_ANALYZE : 0) |
+         (TraceParse ? CM_TRACE_PARSE : 0) | (TraceScan ? CM_TRACE_SCAN : 0) |
+         (TraceCode ? CM_TRACE_CODE : 0) | (EchoSource ? CM_ECHO_SOURCE : 0);
+}
+
+/* Procedure addJob adds the source file path,
+ * which it takes over, to the batch
+ */
+static void addJob(char * path)
+{ const char * name = strrchr(path, '/');
+  char * base;
+  int len;
+  name = name != NULL ? name + 1 : path;
+  len = (int) strcspn(name, ".");
+  if (jobCount == jobSize)
+  { jobSize = jobSize ? 2 * jobSize : 64;
+    jobList = (Job *) realloc(jobList, jobSize * sizeof(Job));
+  }
+  base = (char *) malloc(strlen(outDir) + len + 2);
+  if (jobList == NULL || base == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  sprintf(base, "%s/%.*s", outDir, len, name);
+  memset(&jobList[jobCount], 0, sizeof(Job));
+  jobList[jobCount].path = path;
+  jobList[jobCount].base = base;
+  jobCount++;
+}
+
+static int compareNames(const void * a, const void * b)
+{ return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Function addDirectory adds the .c files of
+ * directory dir to the batch, in the order of
+ * their names; returns FALSE if it cannot be read
+ */
+static int addDirectory(char * dir)
+{ DIR * d = opendir(dir);
+  struct dirent * e;
+  char ** names = NULL;
+  int n = 0, size = 0, i;
+  if (d == NULL) return FALSE;
+  while ((e = readdir(d)) != NULL)
+  { int len = (int) strlen(e->d_name);
+    if (len < 3 || strcmp(e->d_name + len - 2, ".c") != 0) continue;
+    if (n == size)
+    { size = size ? 2 * size : 64;
+      names = (char **) realloc(names, size * sizeof(char *));
+      if (names == NULL)
+      { fprintf(listing,"Out of memory error\n");
+        exit(1);
+      }
+    }
+    names[n++] = joinPath(dir, e->d_name);
+  }
+  closedir(d);
+  qsort(names, n, sizeof(char *), compareNames);
+  for (i = 0; i < n; i++) addJob(names[i]);
+  free(names);
+  return TRUE;
+}
+
+/* Function writeFile writes the size bytes at p
+ * to file path, preceded by head if not NULL
+ */
+static int writeFile(const char * path, const char * head,
+                     const char * p, size_t size)
+{ FILE * f = fopen(path, "w");
+  int ok;
+  if (f == NULL) return FALSE;
+  if (head != NULL) fputs(head, f);
+  fwrite(p, 1, size, f);
+  ok = !ferror(f);
+  return fclose(f) == 0 && ok;
+}
+
+/* Procedure compileJob compiles the source file
+ * of job j with compiler c and writes its listing
+ * and code, timing it
+ */
+static void compileJob(Compiler c, Job * j)
+{ struct timespec t0, t1;
+  struct stat st;
+  const char * text = "";
+  char * path;
+  char head[256];
+  char stamp[32];
+  time_t now;
+  struct tm tm;
+  size_t size;
+  const char * code;
+  int fd;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  fd = open(j->path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0)
+  { if (fd >= 0) close(fd);
+    j->failed = TRUE;
+    return;
+  }
+  if (st.st_size > 0)
+  { void * p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+    { close(fd);
+      j->failed = TRUE;
+      return;
+    }
+    text = (const char *) p;
+  }
+  close(fd);
+  path = (char *) malloc(strlen(j->base) + 5);
+  if (path == NULL)
+  { fprintf(stderr,"Out of memory error\n");
+    exit(1);
+  }
+  sprintf(path, "%s.tm", j->base);
+  compileBuffer(c, path, text, (long) st.st_size);
+  if (st.st_size > 0) munmap((void *) text, st.st_size);
+  j->errors = compilerErrors(c);
+  code = compilerCode(c, &size);
+  /* as after a single file, no code is left after an error */
+  if (j->errors == 0)
+  { if (!writeFile(path, NULL, code, size)) j->failed = TRUE;
+  }
+  else remove(path);
+  /* the listing begins as that of the command line */
+  time(&now);
+  localtime_r(&now, &tm);
+  snprintf(head, sizeof(head), "\nCMINUS COMPILATION: %s\nTIME OF COMPILATION: %s",
+           j->path, asctime_r(&tm, stamp));
+  sprintf(path, "%s.txt", j->base);
+  code = compilerDiagnostics(c, &size);
+  if (!writeFile(path, head, code, size)) j->failed = TRUE;
+  free(path);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  j->ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+/* Procedure worker is run by every thread of the
+ * pool: it compiles jobs, each with the next
+ * unclaimed file, until none is left
+ */
+static void * worker(void * arg)
+{ Compiler c = newCompiler(options);
+  int i;
+  (void) arg;
+  if (c == NULL)
+  { fprintf(stderr,"Out of memory error\n");
+    exit(1);
+  }
+  while ((i = atomic_fetch_add(&nextJob, 1)) < jobCount)
+    compileJob(c, &jobList[i]);
+  freeCompiler(c);
+  return NULL;
+}
+
+/* Function compileBatch compiles the inputs on a
+ * pool of jobs threads, the calling thread being
+ * one of them, with the options of the command
+ * line, and prints a summary in the order of the
+ * inputs
+ */
+int compileBatch(char ** inputs, int n, char * outdir, int jobs)
+{ pthread_t * threads;
+  struct timespec t0, t1;
+  struct stat st;
+  double ms;
+  int i, failed = 0, withErrors = 0;
+  outDir = outdir;
+  if (stat(outdir, &st) != 0 && mkdir(outdir, 0777) != 0)
+  { fprintf(stderr,"Unable to create %s\n",outdir);
+    return n;
+  }
+  jobCount = 0;
+  for (i = 0; i < n; i++)
+    if (stat(inputs[i], &st) == 0 && S_ISDIR(st.st_mode))
+    { if (!addDirectory(inputs[i]))
+      { fprintf(stderr,"Unable to read %s\n",inputs[i]);
+        failed++;
+      }
+    }
+    else
+    { char * path = strdup(inputs[i]);
+      if (path == NULL)
+      { fprintf(listing,"Out of memory error\n");
+        exit(1);
+      }
+      addJob(path);
+    }
+  options = commandOptions();
+  if (jobs < 1) jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (jobs < 1) jobs = 1;
+  if (jobs > jobCount) jobs = jobCount > 0 ? jobCount : 1;
+  threads = (pthread_t *) malloc(jobs * sizeof(pthread_t));
+  if (threads == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  atomic_store(&nextJob, 0);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i = 1; i < jobs; i++)
+    pthread_create(&threads[i], NULL, worker, NULL);
+  worker(NULL);
+  for (i = 1; i < jobs; i++)
+    pthread_join(threads[i], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+  free(threads);
+  fprintf(listing,"%-32s %10s %8s\n","file","ms","errors");
+  for (i = 0; i < jobCount; i++)
+  { Job * j = &jobList[i];
+    if (j->failed)
+    { fprintf(listing,"%-32s %10.3f %8s\n",j->path,j->ms,"failed");
+      failed++;
+    }
+    else fprintf(listing,"%-32s %10.3f %8d\n",j->path,j->ms,j->errors);
+    if (j->errors > 0) withErrors++;
+    free(j->path);
+    free(j->base);
+  }
+  fprintf(listing,"%d file%s, %d with errors, %d failed, %.3f ms, %.1f files/s on %d thread%s\n",
+          jobCount,jobCount == 1 ? "" : "s",withErrors,failed,ms,
+          ms > 0 ? jobCount / (ms / 1e3) : 0.0,jobs,jobs == 1 ? "" : "s");
+  free(jobList);
+  jobList = NULL;
+  jobCount = jobSize = 0;
+  return failed;
+}
@@ -0,0 +1,30 @@
+/****************************************************/
+/* File: batch.h                                    */
+/* Compilation of many source files on a pool of    */
+/* threads for the CMINUS compiler                  */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+/* Function commandOptions returns the options of
+ * the compiler library that stand for the flags
+ * of the command line
+ */
+int commandOptions(void);
+
+/* Function compileBatch compiles the n source
+ * files or directories of inputs, a directory
+ * standing for the .c files in it, on jobs
+ * threads with the compiler library. The listing
+ * of a file x.c goes to outdir/x.txt and its code,
+ * if it has no errors, to outdir/x.tm. A summary
+ * of the time and the errors of each file is
+ * printed to the listing file. Returns the number
+ * of files that could not be read or written.
+ */
+int compileBatch(char ** inputs, int n, char * outdir, int jobs);
+
+#endif
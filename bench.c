@@ -0,0 +1,443 @@
+/****************************************************/
+/* File: bench.c                                    */
+/* Benchmarks for the CMINUS compiler               */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <pthread.h>
+#include <time.h>
+#include "util.h"
+#include "arena.h"
+#include "scan.h"
+#include "ast.h"
+#include "intern.h"
+#include "symtab.h"
+#include "compiler.h"
+#include "serve.h"
+#include "bench.h"
+
+/* Function elapsed returns the seconds
+ * between two monotonic clock readings
+ */
+static double elapsed(struct timespec * from, struct timespec * to)
+{ return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/* Function scanOnce scans the whole source file
+ * with the selected scanner and returns the
+ * number of tokens seen
+ */
+static long scanOnce(int flex)
+{ long tokens = 0;
+  FlexScan = flex;
+  rewind(source);
+  resetScanner();
+  lineno = 0;
+  while (getToken() != ENDFILE) tokens++;
+  return tokens;
+}
+
+/* Procedure scanBenchmark scans the source file
+ * rounds times with each scanner and reports the
+ * throughput of both in MB/s to the listing file
+ */
+void scanBenchmark(int rounds)
+{ static char * names[] = { "dfa", "flex" };
+  int savedFlex = FlexScan;
+  int savedTrace = TraceScan;
+  long bytes;
+  int s, r;
+  fseek(source, 0, SEEK_END);
+  bytes = ftell(source);
+  TraceScan = FALSE;
+  fprintf(listing,"\nScanner benchmark: %ld bytes, %d rounds\n",bytes,rounds);
+  for (s = 0; s < 2; s++)
+  { struct timespec t0, t1;
+    long tokens = 0;
+    double secs;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (r = 0; r < rounds; r++) tokens = scanOnce(s);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = elapsed(&t0, &t1);
+    fprintf(listing,"%-5s %10ld tokens %10.3f s %10.2f MB/s\n",names[s],tokens,secs,
+            secs > 0 ? (double) bytes * rounds / secs / 1e6 : 0.0);
+  }
+  FlexScan = savedFlex;
+  TraceScan = savedTrace;
+  rewind(source);
+  resetScanner();
+  lineno = 0;
+}
+
+/* the work done at each node by the traversal
+ * benchmark: a checksum of lines and kinds
+ */
+static unsigned long visitSum;
+static long visitCount;
+
+static void ptrVisit(TreeNode * t)
+{ visitSum += t->lineno * 31 + t->kind.stmt;
+  visitCount++;
+}
+
+static void ptrNull(TreeNode * t)
+{ (void) t;
+}
+
+/* Procedure ptrTraverse walks the pointer tree
+ * in the same way as traverse in analyze.c
+ */
+static void ptrTraverse(TreeNode * t,
+                        void (* preProc) (TreeNode *),
+                        void (* postProc) (TreeNode *))
+{ while (t != NULL)
+  { int i;
+    preProc(t);
+    for (i = 0; i < MAXCHILDREN; i++)
+      ptrTraverse(t->child[i], preProc, postProc);
+    postProc(t);
+    t = t->sibling;
+  }
+}
+
+static void flatVisit(FlatTree * f, NodeId n)
+{ visitSum += f->line[n] * 31 + (f->kind[n] & (FLATEXP - 1));
+  visitCount++;
+}
+
+static void flatNull(FlatTree * f, NodeId n)
+{ (void) f;
+  (void) n;
+}
+
+/* Procedure astBenchmark compares the memory and
+ * traversal time of the pointer syntax tree t with
+ * those of its compact store, walking each rounds
+ * times, and reports both to the listing file
+ */
+void astBenchmark(TreeNode * t, int rounds)
+{ struct timespec t0, t1, t2, t3;
+  FlatTree * f;
+  unsigned long ptrSum, flatSum;
+  long nodes;
+  int r;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  f = flattenTree(t);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  visitSum = 0;
+  visitCount = 0;
+  for (r = 0; r < rounds; r++) ptrTraverse(t, ptrVisit, ptrNull);
+  ptrSum = visitSum;
+  nodes = visitCount / rounds;
+  clock_gettime(CLOCK_MONOTONIC, &t2);
+  visitSum = 0;
+  for (r = 0; r < rounds; r++) flatTraverse(f, f->root, flatVisit, flatNull);
+  flatSum = visitSum;
+  clock_gettime(CLOCK_MONOTONIC, &t3);
+  fprintf(listing,"\nSyntax tree benchmark: %ld nodes, %d rounds\n",nodes,rounds);
+  fprintf(listing,"%-8s %12ld bytes %10.3f ms/walk\n","pointer",
+          nodes * (long) sizeof(TreeNode),elapsed(&t1, &t2) * 1e3 / rounds);
+  fprintf(listing,"%-8s %12ld bytes %10.3f ms/walk %10.3f ms to build\n","flat",
+          (long) f->count * flatBytes() + f->names * (long) sizeof(char *) +
+          f->idSize * (long) (sizeof(char *) + sizeof(int)),
+          elapsed(&t2, &t3) * 1e3 / rounds,elapsed(&t0, &t1) * 1e3);
+  if (ptrSum != flatSum || f->count != nodes)
+    fprintf(listing,"BUG: the compact store differs from the tree\n");
+  freeFlatTree(f);
+}
+
+/* Procedure symtabBenchmark declares n generated
+ * global identifiers, looks each of them up, looks
+ * up n undeclared ones, and opens n scopes that
+ * each shadow one of them, then reports the time
+ * per operation to the listing file
+ */
+void symtabBenchmark(int n)
+{ struct timespec t0, t1, t2, t3, t4;
+  char ** names = (char **) malloc(2 * (size_t) n * sizeof(char *));
+  char buf[32];
+  long found = 0, missing = 0, shadowed = 0;
+  int i;
+  if (names == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    return;
+  }
+  for (i = 0; i < 2 * n; i++)
+  { sprintf(buf,"v%d",i);
+    names[i] = internString(buf);
+  }
+  st_clear();
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i = 0; i < n; i++)
+    st_declare(names[i], i, i, 1, 1);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  for (i = 0; i < n; i++)
+    if (st_lookup(names[i], ST_VISIBLE) == i) found++;
+  clock_gettime(CLOCK_MONOTONIC, &t2);
+  for (i = n; i < 2 * n; i++)
+    if (st_lookup(names[i], ST_VISIBLE) == -1) missing++;
+  clock_gettime(CLOCK_MONOTONIC, &t3);
+  for (i = 0; i < n; i++)
+  { st_enterScope(nameMain);
+    st_declare(names[i], i, -2, 1, 1);
+    if (st_lookup(names[i], ST_VISIBLE) == -2) shadowed++;
+    st_exitScope();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t4);
+  fprintf(listing,"\nSymbol table benchmark: %d symbols\n",n);
+  fprintf(listing,"%-12s %10.1f ns/op\n","insert",elapsed(&t0, &t1) * 1e9 / n);
+  fprintf(listing,"%-12s %10.1f ns/op\n","lookup hit",elapsed(&t1, &t2) * 1e9 / n);
+  fprintf(listing,"%-12s %10.1f ns/op\n","lookup miss",elapsed(&t2, &t3) * 1e9 / n);
+  fprintf(listing,"%-12s %10.1f ns/op\n","shadow scope",elapsed(&t3, &t4) * 1e9 / n);
+  if (found != n || missing != n || shadowed != n ||
+      st_lookup(names[0], ST_VISIBLE) != 0)
+    fprintf(listing,"BUG: %ld of %d symbols found, %ld absent, %ld shadowed\n",
+            found,n,missing,shadowed);
+  st_printStats(listing);
+  st_clear();
+  free(names);
+}
+
+/* LOCALS is the number of locals each reader of
+ * symtabThreadBenchmark declares; READS is the
+ * number of times the readers look up each global
+ */
+#define LOCALS 16
+#define READS 8
+
+/* the work of one reader of the published scope */
+typedef struct
+   { char ** names; /* the n globals, then the locals */
+     int n;
+     long lookups;  /* lookups to do */
+     long start;    /* where in names to begin */
+     long found;
+   } Reader;
+
+/* the globals of the thread running the benchmark */
+static Globals parent;
+
+/* Procedure readGlobals declares the locals of a
+ * function in a table of its own, then looks up
+ * globals, each eighth lookup a local instead
+ */
+static void * readGlobals(void * arg)
+{ Reader * r = (Reader *) arg;
+  Arena locals = {0};
+  long i, found = 0;
+  int j;
+  loadGlobals(&parent);
+  currentArena = &locals;
+  st_beginThread();
+  st_enterScope(nameMain);
+  for (j = 0; j < LOCALS; j++)
+    st_declare(r->names[r->n + j], 0, -1 - j, 1, 1);
+  for (i = 0; i < r->lookups; i++)
+  { long k = (r->start + i) % r->n;
+    if ((i & 7) == 7)
+      found += st_lookup(r->names[r->n + (i & (LOCALS - 1))], ST_VISIBLE) < 0;
+    else
+      found += st_lookup(r->names[k], ST_VISIBLE) == k;
+  }
+  r->found = found;
+  st_endThread();
+  arenaRelease(&locals);
+  return NULL;
+}
+
+/* Procedure symtabThreadBenchmark declares n
+ * global identifiers, publishes the global scope
+ * and has 1 to threads readers, each with its
+ * locals in a table of its own, share READS * n
+ * lookups; it reports the lookup rate and the
+ * speedup over one reader to the listing file
+ */
+void symtabThreadBenchmark(int n, int threads)
+{ char ** names = (char **) malloc(((size_t) n + LOCALS) * sizeof(char *));
+  Reader * readers = (Reader *) malloc(threads * sizeof(Reader));
+  pthread_t * ids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+  long total = (long) READS * n;
+  double base = 0;
+  char buf[32];
+  int i, t;
+  if (names == NULL || readers == NULL || ids == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    return;
+  }
+  for (i = 0; i < n + LOCALS; i++)
+  { sprintf(buf, i < n ? "g%d" : "l%d", i);
+    names[i] = internString(buf);
+  }
+  st_clear();
+  for (i = 0; i < n; i++)
+    st_declare(names[i], i, i, 1, 1);
+  st_publish();
+  saveGlobals(&parent);
+  fprintf(listing,"\nPublished global scope: %d symbols, %ld lookups\n",n,total);
+  fprintf(listing,"%-8s %10s %12s %8s\n","readers","ms","Mlookups/s","speedup");
+  for (t = 1; t <= threads; t++)
+  { struct timespec t0, t1;
+    long found = 0;
+    double secs;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < t; i++)
+    { readers[i].names = names;
+      readers[i].n = n;
+      readers[i].lookups = total / t + (i < total % t);
+      readers[i].start = (long) i * n / t;
+      readers[i].found = 0;
+      pthread_create(&ids[i], NULL, readGlobals, &readers[i]);
+    }
+    for (i = 0; i < t; i++)
+    { pthread_join(ids[i], NULL);
+      found += readers[i].found;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = elapsed(&t0, &t1);
+    if (t == 1) base = secs;
+    fprintf(listing,"%-8d %10.1f %12.1f %8.2f\n",t,secs * 1e3,total / secs / 1e6,base / secs);
+    if (found != total)
+      fprintf(listing,"BUG: %ld of %ld lookups found\n",found,total);
+  }
+  st_clear();
+  free(names);
+  free(readers);
+  free(ids);
+}
+
+/* the work of one thread of compileBenchmark */
+typedef struct
+   { const char * text;
+     long len;
+     int rounds;  /* compilations to do */
+     int failed;  /* compilations with errors */
+   } Builder;
+
+static void * compileRounds(void * arg)
+{ Builder * b = (Builder *) arg;
+  Compiler c = newCompiler(0);
+  int i;
+  b->failed = 0;
+  if (c == NULL)
+  { b->failed = b->rounds;
+    return NULL;
+  }
+  for (i = 0; i < b->rounds; i++)
+    if (!compileBuffer(c, "bench.tm", b->text, b->len)) b->failed++;
+  freeCompiler(c);
+  return NULL;
+}
+
+/* Procedure compileBenchmark compiles the source
+ * file rounds times with the compiler library on
+ * 1 to threads threads, each with a compiler of
+ * its own, and reports the compilations per
+ * second and the speedup over one thread
+ */
+void compileBenchmark(int rounds, int threads)
+{ Builder * builders = (Builder *) malloc(threads * sizeof(Builder));
+  pthread_t * ids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+  double base = 0;
+  int i, t;
+  if (builders == NULL || ids == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    return;
+  }
+  fprintf(listing,"\nCompiler library: %ld bytes, %d compilations\n",sourceLen,rounds);
+  fprintf(listing,"%-8s %10s %12s %8s\n","threads","ms","compiles/s","speedup");
+  for (t = 1; t <= threads; t++)
+  { struct timespec t0, t1;
+    int failed = 0;
+    double secs;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < t; i++)
+    { builders[i].text = sourceText;
+      builders[i].len = sourceLen;
+      builders[i].rounds = rounds / t + (i < rounds % t);
+      pthread_create(&ids[i], NULL, compileRounds, &builders[i]);
+    }
+    for (i = 0; i < t; i++)
+    { pthread_join(ids[i], NULL);
+      failed += builders[i].failed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = elapsed(&t0, &t1);
+    if (t == 1) base = secs;
+    fprintf(listing,"%-8d %10.1f %12.1f %8.2f\n",t,secs * 1e3,rounds / secs,base / secs);
+    if (failed > 0)
+      fprintf(listing,"%d of %d compilations failed\n",failed,rounds);
+  }
+  free(builders);
+  free(ids);
+}
+
+static int compareTimes(const void * a, const void * b)
+{ double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Procedure printLatency sorts the n request
+ * times in ms and prints their percentiles
+ */
+static void printLatency(char * name, double * ms, int n)
+{ double sum = 0;
+  int i;
+  qsort(ms, n, sizeof(double), compareTimes);
+  for (i = 0; i < n; i++) sum += ms[i];
+  fprintf(listing,"%-10s %10.3f %10.3f %10.3f %10.3f\n",name,
+          ms[(n - 1) / 2],ms[(n - 1) * 99 / 100],ms[n - 1],sum / n);
+}
+
+/* Procedure serveBenchmark sends the source file
+ * rounds times to the compile server on path to
+ * be compiled, checked, and compiled unchanged,
+ * then compiles it in this process, and reports
+ * the latency of each to the listing file
+ */
+void serveBenchmark(char * path, int rounds)
+{ static char * names[] = { "compile", "check", "unchanged", "in-process" };
+  double * ms = (double *) malloc(rounds * sizeof(double));
+  Connection c = connectServer(path);
+  Compiler local = newCompiler(0);
+  char name[32];
+  int k, i, failed = 0;
+  if (ms == NULL || local == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  if (c == NULL)
+  { fprintf(stderr,"Unable to connect to %s\n",path);
+    exit(1);
+  }
+  fprintf(listing,"\nCompile server: %ld bytes, %d requests each\n",sourceLen,rounds);
+  fprintf(listing,"%-10s %10s %10s %10s %10s\n","request","p50 ms","p99 ms","max ms","mean ms");
+  for (k = 0; k < 4; k++)
+  { for (i = 0; i < rounds; i++)
+    { struct timespec t0, t1;
+      Reply r;
+      /* a new name each time keeps the server from answering from memory */
+      snprintf(name, sizeof(name), "bench%d.tm", k == 2 ? 0 : i);
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      if (k == 3)
+        compileBuffer(local, name, sourceText, sourceLen);
+      else if (request(c, k == 1, name, sourceText, sourceLen, &r))
+      { if (r.errors > 0) failed++;
+        freeReply(&r);
+      }
+      else
+      { fprintf(stderr,"Lost the connection to %s\n",path);
+        exit(1);
+      }
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      ms[i] = elapsed(&t0, &t1) * 1e3;
+    }
+    printLatency(names[k], ms, rounds);
+  }
+  if (failed > 0)
+    fprintf(listing,"%d of %d requests had errors\n",failed,3 * rounds);
+  closeConnection(c);
+  freeCompiler(local);
+  free(ms);
+}
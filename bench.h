@@ -0,0 +1,61 @@
+/****************************************************/
+/* File: bench.h                                    */
+/* Benchmarks for the CMINUS compiler               */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/* Procedure scanBenchmark scans the source file
+ * rounds times with each scanner and reports the
+ * throughput of both in MB/s to the listing file
+ */
+void scanBenchmark(int rounds);
+
+/* Procedure astBenchmark compares the memory and
+ * traversal time of the pointer syntax tree t with
+ * those of its compact store, walking each rounds
+ * times, and reports both to the listing file
+ */
+void astBenchmark(TreeNode * t, int rounds);
+
+/* Procedure symtabBenchmark declares n generated
+ * global identifiers, looks each of them up, looks
+ * up n undeclared ones, and opens n scopes that
+ * each shadow one of them, then reports the time
+ * per operation to the listing file
+ */
+void symtabBenchmark(int n);
+
+/* Procedure symtabThreadBenchmark declares n
+ * global identifiers, publishes the global scope
+ * and has 1 to threads readers, each with its
+ * locals in a table of its own, share the same
+ * number of lookups; it reports the lookup rate
+ * and the speedup over one reader to the listing
+ * file
+ */
+void symtabThreadBenchmark(int n, int threads);
+
+/* Procedure compileBenchmark compiles the source
+ * file rounds times with the compiler library on
+ * 1 to threads threads, each with a compiler of
+ * its own, and reports the compilations per
+ * second and the speedup over one thread to the
+ * listing file
+ */
+void compileBenchmark(int rounds, int threads);
+
+/* Procedure serveBenchmark sends the source file
+ * rounds times to the compile server listening on
+ * path to be compiled, to be checked, and to be
+ * compiled again unchanged, compiles it rounds
+ * times in this process as well, and reports the
+ * median, 99th percentile, largest and mean
+ * latency of each to the listing file
+ */
+void serveBenchmark(char * path, int rounds);
+
+#endif
@@ -0,0 +1,218 @@
+# Benchmarks on generated C-minus programs
+# usage: ./benchmark.sh <benchmark>
+#   jobs   compiles a program with many functions on 1 to nproc threads
+#   lists  parses functions with 10^3 to 10^6 statements
+#   exprs  counts the nodes allocated for an expression-heavy program
+#   ast    compares the pointer and compact syntax trees on a million nodes
+#   stream compares the peak memory of batch and streaming compilation
+#   pipeline compares streaming and pipelined compilation
+#   deep   compiles a function with 5 million statements
+#   symtab inserts and looks up 10^6 identifiers in the symbol table,
+#          then reads them on 1 to nproc threads
+#   xref   indexes a program and queries the index
+#   library compares spawning the compiler with the compiler library
+#   batch  compiles many files with a shell loop and with --out
+#   serve  compares spawning the compiler with requests to --serve
+#   watch  times the recompilation of a 50000-line program by --watch
+#          after each of a few edits
+bison -d cminus.y &&
+flex cminus.l &&
+gcc -O2 -c *.c &&
+gcc -o cminus *.o -ll -lpthread &&
+mkdir -p results || exit 1
+
+# genFunctions n prints a program with n functions fna, fnb, ..., fnaa, ...
+genFunctions() {
+  awk -v n="$1" '
+    function name(i,  s) { s = ""; i++; while (i > 0) { i--; s = sprintf("%c", 97 + i % 26) s; i = int(i / 26) } return s }
+    BEGIN {
+      print "int g;"
+      for (f = 0; f < n; f++)
+        printf "int fn%s(int a, int b) { int i; i = 0; /* loop */ while (i < a) { i = i + 1; b = b * 2 + i; } return b; }\n", name(f)
+      print "void main(void) { int x; x = fna(1, 2); }"
+    }'
+}
+
+# genStatements n prints a program whose main function has n statements
+genStatements() {
+  awk -v n="$1" '
+    BEGIN {
+      print "void main(void) { int x; int y;"
+      for (i = 0; i < n; i++)
+        print "  x = x + y * 2;"
+      print "}"
+    }'
+}
+
+# genExpressions n prints a program with 2n expression statements
+genExpressions() {
+  awk -v n="$1" '
+    BEGIN {
+      print "int f(int a, int b) { return a - b; }"
+      print "void main(void) { int x; int y; int z; x = input(); y = input(); z = 1;"
+      for (i = 0; i < n; i++) {
+        print "  x = (x + y * 3 - z / 2) * (y - 1) + f(x * 2, y + z);"
+        print "  if (x < y * 2 + z) z = z + 1; else y = y - x / 3;"
+      }
+      print "  output(x); }"
+    }'
+}
+
+case "$1" in
+  jobs)
+    genFunctions 50000 > results/bench_jobs.c
+    for j in $(seq 1 "$(nproc)")
+    do
+      echo "jobs $j"
+      ./cminus --time-passes --jobs "$j" results/bench_jobs.c 2>&1 >/dev/null |
+        grep -E 'scan\+parse|symtab\+codegen|write'
+    done
+    ;;
+  lists)
+    for n in 1000 10000 100000 1000000
+    do
+      genStatements "$n" > results/bench_lists.c
+      echo "statements $n"
+      ./cminus --time-passes --parse-only results/bench_lists.c 2>&1 >/dev/null | grep scan+parse
+    done
+    ;;
+  exprs)
+    genExpressions 100000 > results/bench_exprs.c
+    for opt in "" --hash-cons
+    do
+      echo "tree ${opt:-(default)}"
+      ./cminus --time-passes --stats --parse-only $opt results/bench_exprs.c 2>&1 >/dev/null
+    done
+    ;;
+  stream)
+    genFunctions 20000 > results/bench_stream.c
+    for opt in "" --stream
+    do
+      echo "compile ${opt:-(batch)}"
+      ./cminus --time-passes --stats $opt results/bench_stream.c 2>&1 >/dev/null
+    done
+    ;;
+  ast)
+    genExpressions 25000 > results/bench_ast.c
+    ./cminus --bench-ast 10 results/bench_ast.c
+    ;;
+  pipeline)
+    genFunctions 20000 > results/bench_pipeline.c
+    for opt in --stream --pipeline
+    do
+      echo "compile $opt"
+      ./cminus --time-passes $opt results/bench_pipeline.c 2>&1 >/dev/null
+    done
+    ;;
+  deep)
+    genStatements 5000000 > results/bench_deep.c
+    ./cminus --time-passes --stats results/bench_deep.c 2>&1 >/dev/null
+    ;;
+  symtab)
+    genFunctions 1 > results/bench_symtab.c
+    ./cminus --jobs "$(nproc)" --bench-symtab 1000000 results/bench_symtab.c
+    ;;
+  xref)
+    genFunctions 20000 > results/bench_xref.c
+    rm -f results/bench_xref.idx
+    ./cminus --time-passes --xref results/bench_xref.idx results/bench_xref.c 2>&1 >/dev/null | grep xref
+    ls -l results/bench_xref.idx
+    for q in --def --refs
+    do
+      echo "query $q"
+      ./cminus --time-passes $q results/bench_xref.idx fna 2>&1 >/dev/null
+    done
+    ;;
+  library)
+    genFunctions 100 > results/bench_library.c
+    echo "spawn 1000"
+    start=$(date +%s%N)
+    for i in $(seq 1000)
+    do
+      ./cminus results/bench_library.c > /dev/null
+    done
+    echo "$(( ($(date +%s%N) - start) / 1000000 )) ms"
+    ./cminus --jobs "$(nproc)" --bench-compile 1000 results/bench_library.c
+    ;;
+  batch)
+    rm -rf results/bench_batch results/bench_batch_out
+    mkdir -p results/bench_batch
+    for i in $(seq 500)
+    do
+      genFunctions 20 > results/bench_batch/prog$i.c
+    done
+    echo "shell loop"
+    start=$(date +%s%N)
+    for file in results/bench_batch/*.c
+    do
+      ./cminus "$file" > /dev/null
+    done
+    echo "$(( ($(date +%s%N) - start) / 1000000 )) ms"
+    rm -f results/bench_batch/*.tm
+    for j in $(seq 1 "$(nproc)")
+    do
+      echo "--out --jobs $j"
+      ./cminus --jobs "$j" --out results/bench_batch_out results/bench_batch | tail -1
+    done
+    ;;
+  serve)
+    genFunctions 20 > results/bench_serve.c
+    genFunctions 2000 > results/bench_serve_large.c
+    rm -f results/bench_serve.sock
+    ./cminus --serve results/bench_serve.sock &
+    server=$!
+    while [ ! -S results/bench_serve.sock ]
+    do
+      sleep 0.1
+    done
+    echo "spawn 1000"
+    start=$(date +%s%N)
+    for i in $(seq 1000)
+    do
+      ./cminus results/bench_serve.c > /dev/null
+    done
+    echo "$(( ($(date +%s%N) - start) / 1000000 )) ms"
+    echo "--connect 1000"
+    start=$(date +%s%N)
+    for i in $(seq 1000)
+    do
+      ./cminus --connect results/bench_serve.sock results/bench_serve.c > /dev/null
+    done
+    echo "$(( ($(date +%s%N) - start) / 1000000 )) ms"
+    ./cminus --connect results/bench_serve.sock --bench-serve 1000 results/bench_serve.c
+    ./cminus --connect results/bench_serve.sock --bench-serve 100 results/bench_serve_large.c
+    kill "$server"
+    ;;
+  watch)
+    mkdir -p results/watch
+    rm -f results/watch/*
+    # 6250 functions of 8 lines
+    genFunctions 6250 | sed 's/{ /{\n  /g; s/; /;\n  /g' > results/watch/prog.c
+    echo "full compilation"
+    start=$(date +%s%N)
+    ./cminus results/watch/prog.c > /dev/null
+    echo "$(( ($(date +%s%N) - start) / 1000000 )) ms"
+    rm -f results/watch/prog.tm
+    ./cminus --watch results/watch > results/bench_watch.txt &
+    watcher=$!
+    until grep -q "prog.c:" results/bench_watch.txt
+    do
+      sleep 0.1
+    done
+    # a constant in one function at a time, then a line added before all but one
+    for k in 1 2 3 4 5
+    do
+      sed -i "$((k * 9000)),/b \* 2/ s/b \* 2/b * 3/" results/watch/prog.c
+      sleep 0.5
+    done
+    sed -i '2s/^/\n/' results/watch/prog.c
+    sleep 0.5
+    kill "$watcher"
+    cat results/bench_watch.txt
+    ;;
+  *)
+    echo "usage: $0 jobs|lists|exprs|ast|stream|pipeline|deep|symtab|xref|library|batch|serve|watch"
+    exit 1
+    ;;
+esac
+./clearfiles.sh
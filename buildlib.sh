@@ -0,0 +1,8 @@
+# builds libcminus.a and libcminus.so, the compiler as a library (see compiler.h)
+objs="lex.yy.o cminus.tab.o compiler.o util.o scan.o tokbuf.o intern.o arena.o hashcons.o analyze.o symtab.o cgen.o code.o"
+bison -d cminus.y &&
+flex cminus.l &&
+gcc -O2 -fPIC -c ${objs//.o/.c} &&
+rm -f libcminus.a &&
+ar rcs libcminus.a $objs &&
+gcc -shared -o libcminus.so $objs -lpthread
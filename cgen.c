@@ -16,11 +16,79 @@
    It is decremented each time a temp is
    stored, and incremeted when loaded again
 */
-static int tmpOffset = 0;
+static THREAD_LOCAL int tmpOffset = 0;
 
 /* prototype for internal recursive code generator */
 static void cGen(TreeNode *tree);
 
+/* MAXTEMPS is the number of shared subexpressions
+ * remembered in a basic block
+ */
+#define MAXTEMPS 256
+
+/* the temps holding the values of shared (hash-consed)
+ * subexpressions computed so far in the current
+ * basic block
+ */
+static THREAD_LOCAL struct
+{
+  TreeNode *exp;
+  int temp;
+} temps[MAXTEMPS];
+static THREAD_LOCAL int ntemps = 0;
+
+/* Function mentions tells whether expression
+ * tree reads variable name
+ */
+static int mentions(TreeNode *tree, char *name)
+{
+  if (tree == NULL || tree->nodekind != ExpK)
+    return FALSE;
+  if (tree->kind.exp == IdK && tree->attr.name == name)
+    return TRUE;
+  return mentions(tree->child[0], name) || mentions(tree->child[1], name);
+}
+
+/* Procedure killTemps forgets the temps of all
+ * expressions reading name, or of all
+ * expressions if name is NULL
+ */
+static void killTemps(char *name)
+{
+  int i, n = 0;
+  if (name == NULL)
+  {
+    ntemps = 0;
+    return;
+  }
+  for (i = 0; i < ntemps; i++)
+    if (!mentions(temps[i].exp, name))
+      temps[n++] = temps[i];
+  ntemps = n;
+}
+
+/* Function findTemp returns the temp holding the
+ * value of tree in this basic block, or -1
+ */
+static int findTemp(TreeNode *tree)
+{
+  int i;
+  for (i = 0; i < ntemps; i++)
+    if (temps[i].exp == tree)
+      return temps[i].temp;
+  return -1;
+}
+
+static void keepTemp(TreeNode *tree, int temp)
+{
+  if (tree->consed && ntemps < MAXTEMPS)
+  {
+    temps[ntemps].exp = tree;
+    temps[ntemps].temp = temp;
+    ntemps++;
+  }
+}
+
 // static void iterateFunction(TreeNode *tree)
 // {
 //   if (tree != NULL)
@@ -46,6 +114,7 @@ static int cGenAssign(TreeNode *tree)
 {
   TreeNode *p1, *p2, *p3;
   int firstRegister, secondRegister;
+  int temp;
   if (tree != NULL)
   {
     switch (tree->nodekind)
@@ -66,39 +135,45 @@ static int cGenAssign(TreeNode *tree)
       switch (tree->kind.exp)
       {
       case OpK:
+        /* a shared subexpression is computed once per basic block */
+        temp = findTemp(tree);
+        if (temp >= 0)
+          return temp + 1;
         p1 = tree->child[0];
         p2 = tree->child[1];
         firstRegister = cGenAssign(p1);
         secondRegister = cGenAssign(p2);
+        temp = getRegisterNumber();
         emitOpAssign(getOpChar(tree));
         if (p1->kind.exp == IdK)
         {
-          fprintf(code, "%s", p1->attr.name);
+          fprintf(unitCode, "%s", p1->attr.name);
         }
         else if (p1->kind.exp == ConstK)
         {
-          fprintf(code, "%d", p1->attr.val);
+          fprintf(unitCode, "%d", p1->attr.val);
         }
         else
         {
-          fprintf(code, "t%d", firstRegister - 1);
+          fprintf(unitCode, TEMP, firstRegister - 1);
         }
 
-        fprintf(code, " %s ", getOpChar(tree));
+        fprintf(unitCode, " %s ", getOpChar(tree));
 
         if (p2->kind.exp == IdK)
         {
-          fprintf(code, "%s", p2->attr.name);
+          fprintf(unitCode, "%s", p2->attr.name);
         }
         else if (p2->kind.exp == ConstK)
         {
-          fprintf(code, "%d", p2->attr.val);
+          fprintf(unitCode, "%d", p2->attr.val);
         }
         else
         {
-          fprintf(code, "t%d", secondRegister - 1);
+          fprintf(unitCode, TEMP, secondRegister - 1);
         }
-        fprintf(code, "\n");
+        fprintf(unitCode, "\n");
+        keepTemp(tree, temp);
         break;
       case IdK:
         p1 = tree->child[0];
@@ -129,6 +204,7 @@ static void genStmt(TreeNode *tree)
   int firstRegister, secondRegister;
   int loc;
   int numParams;
+  int rhsTemp;
   switch (tree->kind.stmt)
   {
 
@@ -140,38 +216,41 @@ static void genStmt(TreeNode *tree)
     emitDeviationAssign();
     if (p2->kind.exp == IdK)
     {
-      fprintf(code, "%s", p2->attr.name);
+      fprintf(unitCode, "%s", p2->attr.name);
     }
     else if (p2->kind.exp == ConstK)
     {
-      fprintf(code, "%d", p2->attr.val);
+      fprintf(unitCode, "%d", p2->attr.val);
     }
 
-    fprintf(code, " %s ", getOpChar(p1));
+    fprintf(unitCode, " %s ", getOpChar(p1));
 
     if (p3->kind.exp == IdK)
     {
-      fprintf(code, "%s", p3->attr.name);
+      fprintf(unitCode, "%s", p3->attr.name);
     }
     else if (p3->kind.exp == ConstK)
     {
-      fprintf(code, "%d", p3->attr.val);
+      fprintf(unitCode, "%d", p3->attr.val);
     }
-    fprintf(code, "\n");
+    fprintf(unitCode, "\n");
 
     emitIf();
 
     p2 = tree->child[1];
     p3 = tree->child[2];
 
+    killTemps(NULL);
     cGen(p3);
 
     emitElse();
     emitDeviation();
 
+    killTemps(NULL);
     cGen(p2);
 
     emitDeviation();
+    killTemps(NULL);
 
     if (TraceCode)
       emitCommentWithLine("<- if", tree->lineno);
@@ -181,33 +260,36 @@ static void genStmt(TreeNode *tree)
     p1 = tree->child[0];
     p2 = p1->child[0];
     p3 = p1->child[1];
+    killTemps(NULL);
     emitWhileDeviation();
 
     if (p2->kind.exp == IdK)
     {
-      fprintf(code, "%s", p2->attr.name);
+      fprintf(unitCode, "%s", p2->attr.name);
     }
     else if (p2->kind.exp == ConstK)
     {
-      fprintf(code, "%d", p2->attr.val);
+      fprintf(unitCode, "%d", p2->attr.val);
     }
 
-    fprintf(code, " %s ", getOpOpositeChar(p1));
+    fprintf(unitCode, " %s ", getOpOpositeChar(p1));
 
     if (p3->kind.exp == IdK)
     {
-      fprintf(code, "%s", p3->attr.name);
+      fprintf(unitCode, "%s", p3->attr.name);
     }
     else if (p3->kind.exp == ConstK)
     {
-      fprintf(code, "%d", p3->attr.val);
+      fprintf(unitCode, "%d", p3->attr.val);
     }
-    fprintf(code, "\n");
+    fprintf(unitCode, "\n");
     emitWhile();
 
     p2 = tree->child[1];
+    killTemps(NULL);
     cGen(p2);
     emitEndWhile();
+    killTemps(NULL);
 
     if (TraceCode)
       emitComment("<- repeat");
@@ -224,6 +306,8 @@ static void genStmt(TreeNode *tree)
     {
       numParams = printNumParams(p2);
     }
+    /* a temp of the rhs may be older than the lhs temps */
+    rhsTemp = p2->nodekind == ExpK && p2->kind.exp == OpK;
     if (firstRegister == secondRegister)
     {
       if (p2->kind.exp == IdK)
@@ -241,36 +325,41 @@ static void genStmt(TreeNode *tree)
     }
     else
     {
-      fprintf(code, "%s = ", tree->attr.name);
+      fprintf(unitCode, "%s = ", tree->attr.name);
     }
-    if (firstRegister == secondRegister)
+    if (firstRegister == secondRegister && !rhsTemp)
     {
       if (p2->kind.exp == IdK)
       {
-        fprintf(code, "%s", p2->attr.name);
+        fprintf(unitCode, "%s", p2->attr.name);
         if (p2->child[0] != NULL)
         {
-          fprintf(code, "[t%d]", getRegisterNumber()-1);
+          fprintf(unitCode, "[" TEMP "]", getRegisterNumber()-1);
         }
-        fprintf(code, "\n");
+        fprintf(unitCode, "\n");
       }
       else if (p2->kind.exp == ConstK)
       {
-        fprintf(code, "%d\n", p2->attr.val);
+        fprintf(unitCode, "%d\n", p2->attr.val);
       }
       else if (p2->kind.exp == ActivK)
       {
 
-        fprintf(code, "call %s,%d\n", p2->attr.name, numParams);
+        fprintf(unitCode, "call %s,%d\n", p2->attr.name, numParams);
       }
     }
     else
     {
       if (p2->kind.exp == OpK)
       {
-        fprintf(code, "t%d\n", secondRegister - 1);
+        fprintf(unitCode, TEMP "\n", secondRegister - 1);
       }
     }
+    /* the call may change any variable, and the array of an
+     * element may be a parameter standing for any other array */
+    killTemps((p2->nodekind == StmtK && p2->kind.stmt == ActivK) || p1->child[0] != NULL
+                  ? NULL
+                  : tree->attr.name);
     // /* now store value */
     // emitAssign("assign value");
     if (TraceCode)
@@ -279,10 +368,10 @@ static void genStmt(TreeNode *tree)
   case DeclK:
     break;
   case ActivK:
-
+    killTemps(NULL);
     numParams = printNumParams(tree);
     printSubRoutine();
-    fprintf(code, "call %s,%d\n", tree->attr.name, numParams);
+    fprintf(unitCode, "call %s,%d\n", tree->attr.name, numParams);
     break;
   case RetK:
     p1 = tree->child[0];
@@ -290,19 +379,19 @@ static void genStmt(TreeNode *tree)
     firstRegister = cGenAssign(p1);
     secondRegister = cGenAssign(p2);
     emitAssign();
-    fprintf(code, "return ");
+    fprintf(unitCode, "return ");
 
     if (p1->kind.exp == IdK)
     {
-      fprintf(code, "%s\n", p1->attr.name);
+      fprintf(unitCode, "%s\n", p1->attr.name);
     }
     else if (p1->kind.exp == ConstK)
     {
-      fprintf(code, "%d\n", p1->attr.val);
+      fprintf(unitCode, "%d\n", p1->attr.val);
     }
     else if (p1->kind.exp == OpK)
     {
-      fprintf(code, "t%d\n", secondRegister);
+      fprintf(unitCode, TEMP "\n", secondRegister);
     }
 
     break;
@@ -318,7 +407,8 @@ static void genStmt(TreeNode *tree)
 
     break;
   case FuncDeclK:
-    fprintf(code, "%s:\n", tree->attr.name);
+    killTemps(NULL);
+    fprintf(unitCode, "%s:\n", tree->attr.name);
     increaseSubroutineLevel();
     p1 = tree->child[1];
     // check case foi void main(void)
@@ -331,7 +421,7 @@ static void genStmt(TreeNode *tree)
   case WriteK:
     numParams = printNumParams(tree);
     printSubRoutine();
-    fprintf(code, "call %s,%d\n", tree->attr.name, numParams);
+    fprintf(unitCode, "call %s,%d\n", tree->attr.name, numParams);
     break;
     // case WriteK:
     //    /* generate code for expression to write */
@@ -425,7 +515,9 @@ static void genExp(TreeNode *tree)
  */
 static void cGen(TreeNode *tree)
 {
-  if (tree != NULL)
+  /* loop over siblings, so that the stack only
+   * grows with the nesting depth */
+  while (tree != NULL)
   {
     switch (tree->nodekind)
     {
@@ -440,7 +532,7 @@ static void cGen(TreeNode *tree)
     default:
       break;
     }
-    cGen(tree->sibling);
+    tree = tree->sibling;
   }
 }
 
@@ -454,18 +546,219 @@ static void cGen(TreeNode *tree)
  * file name as a comment in the code file
  */
 void codeGen(TreeNode *syntaxTree, char *codefile)
+{
+  codeGenStart(codefile);
+  /* generate code for TINY program */
+  while (syntaxTree != NULL)
+  {
+    codeGenDecl(syntaxTree);
+    syntaxTree = syntaxTree->sibling;
+  }
+  codeGenEnd();
+}
+
+/* the temps and labels of the code placed so far */
+static THREAD_LOCAL int placedTemps = 0;
+static THREAD_LOCAL int placedLabels = 0;
+
+/* Procedure codeGenStart writes the prelude */
+void codeGenStart(char *codefile)
 {
   char *s = malloc(strlen(codefile) + 7);
+  unitCode = code;
+  placedTemps = placedLabels = 0;
   strcpy(s, "File: ");
   strcat(s, codefile);
   emitComment("CMINUS COMPILATION");
   emitComment(s);
+  free(s);
   emitTimeOfCompilation();
   /* generate standard prelude */
   emitComment("Standard prelude:");
   emitComment("End of standard prelude.");
-  /* generate code for TINY program */
-  cGen(syntaxTree);
-  /* finish */
+}
+
+/* a stream the code of top-level declarations is
+ * generated into, one after the other
+ */
+typedef struct
+{
+  FILE *file;
+  char *text;
+  size_t size;
+} CodeBuffer;
+
+/* the buffer of this thread, kept from one
+ * declaration to the next
+ */
+static THREAD_LOCAL CodeBuffer unitBuffer;
+
+/* Procedure generate generates the code of the
+ * top-level declaration t, without its siblings,
+ * into the buffer of this thread, numbering its
+ * temps and labels from 0; u is given the text
+ * in the buffer
+ */
+static void generate(TreeNode *t, CodeUnit *u)
+{
+  CodeBuffer *b = &unitBuffer;
+  FILE *saved = unitCode;
+  TreeNode *sibling = t->sibling;
+  if (b->file == NULL)
+    b->file = open_memstream(&b->text, &b->size);
+  else
+    fseek(b->file, 0, SEEK_SET);
+  if (b->file == NULL)
+  {
+    fprintf(listing, "Out of memory error\n");
+    exit(1);
+  }
+  unitCode = b->file;
+  resetNumbers();
+  ntemps = 0;
+  t->sibling = NULL;
+  cGen(t);
+  t->sibling = sibling;
+  fflush(b->file);
+  unitCode = saved;
+  u->text = b->text;
+  u->size = b->size;
+  u->temps = getRegisterNumber();
+  u->labels = getDeviationLevel();
+}
+
+/* Procedure codeGenUnit generates the code of
+ * the top-level declaration t, without its
+ * siblings, into u, numbering its temps and labels
+ * from 0. It may run on any thread.
+ */
+void codeGenUnit(TreeNode *t, CodeUnit *u)
+{
+  char *text;
+  generate(t, u);
+  text = (char *)malloc(u->size + 1);
+  if (text == NULL)
+  {
+    fprintf(listing, "Out of memory error\n");
+    exit(1);
+  }
+  memcpy(text, u->text, u->size);
+  u->text = text;
+}
+
+/* Procedure codeGenRelease frees the buffer of
+ * this thread
+ */
+void codeGenRelease(void)
+{
+  if (unitBuffer.file != NULL)
+  {
+    fclose(unitBuffer.file);
+    free(unitBuffer.text);
+  }
+  unitBuffer.file = NULL;
+  unitBuffer.text = NULL;
+}
+
+/* Function putNumber writes n in decimal at p
+ * and returns the end of it
+ */
+static char *putNumber(char *p, long n)
+{
+  char digits[24];
+  int k = 0;
+  unsigned long u = n < 0 ? -(unsigned long)n : (unsigned long)n;
+  if (n < 0)
+    *p++ = '-';
+  do
+  {
+    digits[k++] = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  while (k > 0)
+    *p++ = digits[--k];
+  return p;
+}
+
+/* Function place writes the code of u to the
+ * code file after that of the units placed
+ * before it, renumbering its temps and labels
+ * after theirs; returns the bytes written
+ */
+static size_t place(CodeUnit *u)
+{
+  char number[24];
+  char *p = u->text;
+  char *end = u->text + u->size;
+  size_t written = 0;
+  while (p < end)
+  {
+    char *q = p;
+    char c;
+    long n;
+    size_t len;
+    while (q < end && *q != '\001' && *q != '\002')
+      q++;
+    fwrite(p, 1, q - p, code);
+    written += q - p;
+    if (q == end)
+      break;
+    c = *q;
+    n = strtol(q + 1, &p, 10);
+    len = putNumber(number, n + (c == '\001' ? placedTemps : placedLabels)) - number;
+    fwrite(number, 1, len, code);
+    written += len;
+  }
+  placedTemps += u->temps;
+  placedLabels += u->labels;
+  return written;
+}
+
+/* Procedure codeGenPlace writes the code of u
+ * after that of the units placed before it and
+ * frees it
+ */
+void codeGenPlace(CodeUnit *u)
+{
+  place(u);
+  free(u->text);
+  u->text = NULL;
+}
+
+/* Function codeGenCopy writes the code of u
+ * after that of the units placed before it and
+ * keeps it; returns the bytes written
+ */
+size_t codeGenCopy(CodeUnit *u)
+{
+  return place(u);
+}
+
+/* Procedure codeGenSkip counts the temps and
+ * labels of u as placed without writing its code,
+ * which the caller copies from a code file where
+ * it was placed after as many temps and labels
+ */
+void codeGenSkip(CodeUnit *u)
+{
+  placedTemps += u->temps;
+  placedLabels += u->labels;
+}
+
+/* Procedure codeGenDecl generates the code of
+ * the top-level declaration t
+ */
+void codeGenDecl(TreeNode *t)
+{
+  CodeUnit u;
+  generate(t, &u);
+  place(&u);
+}
+
+/* Procedure codeGenEnd finishes the code file */
+void codeGenEnd(void)
+{
+  unitCode = code;
   emitComment("End of execution.");
+  codeGenRelease();
 }
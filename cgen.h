@@ -16,4 +16,55 @@
  */
 void codeGen(TreeNode * syntaxTree, char * codefile);
 
+/* Procedures codeGenStart, codeGenDecl and codeGenEnd
+ * generate the same code as codeGen one top-level
+ * declaration at a time: codeGenStart writes the
+ * prelude, codeGenDecl the code of declaration t
+ * and codeGenEnd the end of the code file
+ */
+void codeGenStart(char * codefile);
+void codeGenDecl(TreeNode * t);
+void codeGenEnd(void);
+
+/* the code of a top-level declaration, with its
+ * temps and labels numbered from 0, and the number
+ * of temps and labels it takes
+ */
+typedef struct
+   { char * text;
+     size_t size;
+     int temps;
+     int labels;
+   } CodeUnit;
+
+/* Procedure codeGenUnit generates the code of
+ * the top-level declaration t, without its
+ * siblings, into u; it may run on any thread. codeGenPlace writes the code of
+ * u after that of the units placed before it and
+ * frees it; placing the units of the declarations
+ * in order gives the code of codeGenDecl.
+ */
+void codeGenUnit(TreeNode * t, CodeUnit * u);
+void codeGenPlace(CodeUnit * u);
+
+/* Function codeGenCopy writes the code of u as
+ * codeGenPlace does, but keeps it to be placed
+ * again in a later code file; returns the bytes
+ * written
+ */
+size_t codeGenCopy(CodeUnit * u);
+
+/* Procedure codeGenSkip counts u as placed, for
+ * a caller that writes the code of u it placed in
+ * an earlier code file after as many temps and
+ * labels
+ */
+void codeGenSkip(CodeUnit * u);
+
+/* Procedure codeGenRelease frees the buffer
+ * codeGenUnit and codeGenDecl use on the calling
+ * thread; codeGenEnd frees that of its own
+ */
+void codeGenRelease(void);
+
 #endif
@@ -10,61 +10,113 @@
 #include "globals.h"
 #include "util.h"
 #include "scan.h"
+#include "tokbuf.h"
+#include "hashcons.h"
 #include "parse.h"
 
-#define YYSTYPE TreeNode *
-static char * savedName; /* for use in assignments */
-static int savedLineNo;  /* ditto */
-static int savedNum;     /* for use in assignments */
-static TreeNode * savedTree; /* stores syntax tree for later return */
-static int yylex(void);
-int yyerror(char *s);
+/* parser state is per thread so that top-level
+ * declarations can be parsed in parallel
+ */
+static THREAD_LOCAL char * savedName; /* for use in assignments */
+static THREAD_LOCAL int savedLineNo;  /* ditto */
+static THREAD_LOCAL int savedNum;     /* for use in assignments */
+static THREAD_LOCAL TreeNode * savedTree; /* stores syntax tree for later return */
+static THREAD_LOCAL TokenBuffer * tokens; /* replayed instead of scanning if not NULL */
+static THREAD_LOCAL TokenType lastToken; /* lookahead, for error messages */
+static THREAD_LOCAL int quiet; /* TRUE: syntax errors are not reported */
+static THREAD_LOCAL DeclProc declProc; /* if not NULL, takes each top-level declaration */
+static THREAD_LOCAL TokenSource tokenSource; /* if not NULL, used instead of getToken */
+
+/* Function single returns the list holding
+ * just t, or the empty list if t is NULL; a
+ * shared expression node is copied, since its
+ * sibling is set when the list grows
+ */
+static NodeList single(TreeNode * t)
+{ NodeList l;
+  l.head = l.tail = unshareNode(t);
+  return l;
+}
+
+/* Function append joins list b to the end
+ * of list a in constant time
+ */
+static NodeList append(NodeList a, NodeList b)
+{ if (a.head == NULL) return b;
+  if (b.head == NULL) return a;
+  a.tail->sibling = b.head;
+  a.tail = b.tail;
+  return a;
+}
+
+/* Function takeDecl appends the top-level
+ * declaration t to list l, or hands it over to
+ * declProc as soon as it is parsed
+ */
+static NodeList takeDecl(NodeList l, TreeNode * t)
+{ if (declProc == NULL) return append(l, single(t));
+  declProc(t);
+  return l;
+}
 
 %}
 
+%define api.pure full
+
+/* lists of declarations, parameters, statements and
+ * arguments carry their last node, so that each
+ * element is appended in constant time; operators
+ * are passed up as their token, not as a node
+ */
+%union { TreeNode * tree;
+         NodeList list;
+         TokenType op; }
+
+%{
+static int yylex(YYSTYPE * lvalp);
+int yyerror(const char *s);
+%}
+
 %token IF ELSE INT RETURN VOID WHILE EMPTY
 %token ID NUM
 %token EQ LT GT GEQ LEQ EQEQ INEQ PLUS COMMA MINUS TIMES OVER
 LPAREN RPAREN LBRACKETS RBRACKETS LCBRACES RCBRACES SEMI
 %token ERROR
 
+%type <list> decl_list param_list comp_decl loc_decl stmt_list stmt arg_list
+%type <tree> decl var_decl type_spec fun_decl params param exp_decl sel_decl
+%type <tree> iter_decl rtrn_decl exp var simple_exp sum_exp term factor
+%type <tree> activ args
+%type <op> relational sum mult
+
 %% /* Grammar for Cminus */
 
 program     : decl_list
                 { 
-                  savedTree = $1;
+                  savedTree = $1.head;
                 }
             ;
-decl_list    : decl_list decl {
-                YYSTYPE t = $1;
-                if (t != NULL) {
-                  while (t->sibling != NULL) {
-                    t = t->sibling;
-                  }
-                  t->sibling = $2;
-                  $$ = $1;
-                } else { $$ = $2; }
-            }
-            | decl  { $$ = $1; }
+decl_list    : decl_list decl { $$ = takeDecl($1, $2); }
+            | decl  { $$ = takeDecl(single(NULL), $1); }
             ;
 decl        : var_decl { $$ = $1; }
             | fun_decl { $$ = $1; }
             ;
 var_decl    : type_spec ID {
-                $$ = $1;
-                savedName = copyString(globalId);
+                $<tree>$ = $1;
+                savedName = identifierName();
                 savedLineNo = lineno;
-                $$->child[0] = newStmtNode(VarDeclK);
-                $$->child[0]->attr.name = savedName;
-                $$->child[0]->lineno = savedLineNo;
+                $<tree>$->child[0] = newStmtNode(VarDeclK);
+                $<tree>$->child[0]->attr.name = savedName;
+                $<tree>$->child[0]->lineno = savedLineNo;
                 } SEMI {
-                  $$ = $3;
+                  $$ = $<tree>3;
                 }
             | type_spec ID {
-                savedName = copyString(globalId);
+                savedName = identifierName();
                 savedLineNo = lineno;
               }
-              LBRACKETS NUM { savedNum = atoi(tokenString); } RBRACKETS SEMI  {
+              LBRACKETS NUM { savedNum = tokenValue(); } RBRACKETS SEMI  {
                 $$ = $1;
                 $$->child[0] = newStmtNode(ArrDeclK);
                 $$->child[0]->attr.name = savedName;
@@ -75,100 +127,65 @@ var_decl    : type_spec ID {
             ;
 type_spec   : INT {
                 $$ = newStmtNode(TypeK);
-                $$->attr.name = copyString(tokenString);
+                $$->attr.name = tokenName();
             }
             | VOID {
                 $$ = newStmtNode(TypeK);
-                $$->attr.name = copyString(tokenString);
+                $$->attr.name = tokenName();
             }
             ;
 fun_decl    : type_spec ID {
-                  savedName = copyString(globalId);
+                  savedName = identifierName();
                   savedLineNo = lineno;
-                  $$ = $1;
-                  $$->child[0] = newStmtNode(FuncDeclK);
-                  $$->child[0]->attr.name = savedName;
-                  $$->child[0]->lineno = savedLineNo;
+                  consReset();
+                  $<tree>$ = $1;
+                  $<tree>$->child[0] = newStmtNode(FuncDeclK);
+                  $<tree>$->child[0]->attr.name = savedName;
+                  $<tree>$->child[0]->lineno = savedLineNo;
                 } LPAREN params RPAREN comp_decl {
-               $$ = $3;
+               $$ = $<tree>3;
                $$->child[0]->child[0] = $5;
-               $$->child[0]->child[1] = $7;
+               $$->child[0]->child[1] = $7.head;
             }
             ;
-params      : param_list { $$ = $1; }
+params      : param_list { $$ = $1.head; }
             | VOID {
                 $$ = NULL;
             }
             ;
-param_list  : param_list COMMA param {
-                YYSTYPE t = $1;
-                if (t != NULL) {
-                  while (t->sibling != NULL) {
-                    t = t->sibling;
-                  }
-                  t->sibling = $3;
-                  $$ = $1;
-                } else { $$ = $3; }
-            }
-            | param { $$ = $1; }
+param_list  : param_list COMMA param { $$ = append($1, single($3)); }
+            | param { $$ = single($1); }
             ;
 param       : type_spec ID {
-                savedName = copyString(globalId); 
+                savedName = identifierName(); 
                 savedLineNo = lineno;
-                $$ = $1;
-                $$->child[0] = newStmtNode(VarDeclK);
-                $$->child[0]->attr.name = savedName;
-                $$->child[0]->lineno = lineno;
+                $<tree>$ = $1;
+                $<tree>$->child[0] = newStmtNode(VarDeclK);
+                $<tree>$->child[0]->attr.name = savedName;
+                $<tree>$->child[0]->lineno = lineno;
                 } {
-                $$ = $3;
+                $$ = $<tree>3;
             }
-            | type_spec ID { savedName = copyString(globalId); savedLineNo = lineno; }  LBRACKETS RBRACKETS {
+            | type_spec ID { savedName = identifierName(); savedLineNo = lineno; }  LBRACKETS RBRACKETS {
                 $$ = $1;
                 $$->child[0] = newStmtNode(ArrDeclK);
                 $$->child[0]->attr.name = savedName;
                 $$->child[0]->lineno = lineno;
             }
             ;
-comp_decl   : LCBRACES loc_decl stmt_list RCBRACES {
-                YYSTYPE t = $2;
-                if (t != NULL) {
-                  while (t->sibling != NULL) {
-                    t = t->sibling;
-                  }
-                  t->sibling = $3;
-                  $$ = $2;
-                } else { $$ = $3; }
-            }
+comp_decl   : LCBRACES loc_decl stmt_list RCBRACES { $$ = append($2, $3); }
             ;
-loc_decl    : loc_decl var_decl {
-                YYSTYPE t = $1;
-                if (t != NULL) {
-                  while (t->sibling != NULL) {
-                    t = t->sibling;
-                  }
-                  t->sibling = $2;
-                  $$ = $1;
-                } else { $$ = $2; }
-            }
-            | %empty { $$ = NULL; }
+loc_decl    : loc_decl var_decl { $$ = append($1, single($2)); }
+            | %empty { $$ = single(NULL); }
             ;
-stmt_list   : stmt_list stmt {
-                YYSTYPE t = $1;
-                if (t != NULL) {
-                  while (t->sibling != NULL) {
-                    t = t->sibling;
-                  }
-                  t->sibling = $2;
-                  $$ = $1;
-                } else { $$ = $2; }
-            }
-            | %empty { $$ = NULL; }
+stmt_list   : stmt_list stmt { $$ = append($1, $2); }
+            | %empty { $$ = single(NULL); }
             ;
-stmt        : exp_decl { $$ = $1; }
+stmt        : exp_decl { $$ = single($1); }
             | comp_decl { $$ = $1; }
-            | sel_decl { $$ = $1; }
-            | iter_decl { $$ = $1; }
-            | rtrn_decl { $$ = $1;}
+            | sel_decl { $$ = single($1); }
+            | iter_decl { $$ = single($1); }
+            | rtrn_decl { $$ = single($1); }
             ;
 exp_decl    : exp SEMI { $$ = $1; }
             | SEMI { $$ = NULL; }
@@ -176,19 +193,19 @@ exp_decl    : exp SEMI { $$ = $1; }
 sel_decl    : IF LPAREN exp RPAREN stmt {
                 $$ = newStmtNode(IfK);
                 $$->child[0] = $3;
-                $$->child[1] = $5;
+                $$->child[1] = $5.head;
               }
             | IF LPAREN exp RPAREN stmt ELSE stmt {
               $$ = newStmtNode(IfK);
               $$->child[0] = $3;
-              $$->child[1] = $5;
-              $$->child[2] = $7;
+              $$->child[1] = $5.head;
+              $$->child[2] = $7.head;
             }
             ;
 iter_decl   : WHILE LPAREN exp RPAREN stmt {
                 $$ = newStmtNode(RepeatK);
                 $$->child[0] = $3;
-                $$->child[1] = $5;
+                $$->child[1] = $5.head;
             }
             ;
 rtrn_decl   : RETURN
@@ -209,144 +226,117 @@ exp         : var EQ exp {
               }
             | simple_exp {  $$ = $1; }
             ;
-var         : ID {
-                  $$ = newExpNode(IdK);
-                  $$->attr.name = copyString(globalId);
-                  $$->lineno = savedLineNo; }
+var         : ID { $$ = consId(identifierName(), NULL, lineno); }
             | ID {
-              savedName = copyString(globalId);
+              savedName = identifierName();
               savedLineNo = lineno;
             } LBRACKETS exp RBRACKETS {
-              $$ = newExpNode(IdK);
-              $$->child[0] = $4;
-              $$->attr.name = savedName;
-              $$->lineno = savedLineNo;
+              $$ = consId(savedName, $4, savedLineNo);
             }
             ;
-simple_exp  : sum_exp relational sum_exp {
-              $$ = newExpNode(OpK);
-              $$->child[0] = $1;
-              $$->child[1] = $3;
-              $$->attr.op = $2->attr.op;
-            }
+simple_exp  : sum_exp relational sum_exp { $$ = consOp($2, $1, $3); }
             | sum_exp { $$ = $1;}
             ;
-relational  : LEQ {
-                $$ = newExpNode(OpK);
-                $$->attr.op = LEQ;
-            }
-            | LT {
-                $$ = newExpNode(OpK);
-                $$->attr.op = LT;
-            }
-            | GT {
-                $$ = newExpNode(OpK);
-                $$->attr.op = GT;
-            }
-            | GEQ {
-                $$ = newExpNode(OpK);
-                $$->attr.op = GEQ;
-            }
-            | EQEQ {
-                $$ = newExpNode(OpK);
-                $$->attr.op = EQEQ;
-            }
-            | INEQ {
-                $$ = newExpNode(OpK);
-                $$->attr.op = INEQ;
-            }
+relational  : LEQ { $$ = LEQ; }
+            | LT { $$ = LT; }
+            | GT { $$ = GT; }
+            | GEQ { $$ = GEQ; }
+            | EQEQ { $$ = EQEQ; }
+            | INEQ { $$ = INEQ; }
             ;
-sum_exp     : sum_exp sum term {
-              $$ = newExpNode(OpK);
-              $$->child[0] = $1;
-              $$->child[1] = $3;
-              $$->attr.op = $2->attr.op;
-            }
+sum_exp     : sum_exp sum term { $$ = consOp($2, $1, $3); }
             | term { $$ = $1; }
             ;
-sum         : PLUS {
-                $$ = newExpNode(OpK);
-                $$->attr.op = PLUS;
-            }
-            | MINUS {
-                $$ = newExpNode(OpK);
-                $$->attr.op = MINUS;
-             }
+sum         : PLUS { $$ = PLUS; }
+            | MINUS { $$ = MINUS; }
             ;
-term        : term mult factor {
-                $$ = newExpNode(OpK);
-                $$->child[0] = $1;
-                $$->child[1] = $3;
-                $$->attr.op = $2->attr.op;
-            }
+term        : term mult factor { $$ = consOp($2, $1, $3); }
             | factor { $$ = $1; }
             ;
-mult        : TIMES {
-                $$ = newExpNode(OpK);
-                $$->attr.op = TIMES;
-            }
-            | OVER {
-               $$ = newExpNode(OpK);
-               $$->attr.op = OVER;
-            }
+mult        : TIMES { $$ = TIMES; }
+            | OVER { $$ = OVER; }
             ;
 factor      : LPAREN exp RPAREN { $$ = $2; }
             | var { $$ = $1; }
             | activ { $$ = $1; }
-            | NUM {
-              $$ = newExpNode(ConstK);
-              $$->attr.val = atoi(tokenString);
-            }
+            | NUM { $$ = consConst(tokenValue()); }
             ;
 activ       : ID {
-                savedName = copyString(globalId);
+                savedName = identifierName();
                 savedLineNo = lineno;
-                $$ = newStmtNode(ActivK);
-                $$->attr.name = savedName;
-                $$->lineno = savedLineNo;
+                $<tree>$ = newStmtNode(ActivK);
+                $<tree>$->attr.name = savedName;
+                $<tree>$->lineno = savedLineNo;
               }
               LPAREN args RPAREN {
-                $$ = $2;
+                $$ = $<tree>2;
                 $$->child[0] = $4;
             }
             ;
 args        : arg_list {
-                 $$ = $1;
+                 $$ = $1.head;
               }
             | %empty { $$ = NULL; }
             ;
-arg_list    : arg_list COMMA exp {
-                YYSTYPE t = $1;
-                if (t != NULL) {
-                  while (t->sibling != NULL) {
-                    t = t->sibling;
-                  }
-                  t->sibling = $3;
-                  $$ = $1;
-                } else {
-                  $$ = $3;
-                }
-              }
-            | exp {  $$ = $1;  }
+arg_list    : arg_list COMMA exp { $$ = append($1, single($3)); }
+            | exp { $$ = single($1); }
             ;
 %%
 
-int yyerror(char * message)
-{ fprintf(listing,"Syntax error at line %d: %s\n",lineno,message);
+int yyerror(const char * message)
+{ if (quiet) return 0;
+  fprintf(listing,"Syntax error at line %d: %s\n",lineno,message);
   fprintf(listing,"Current token: ");
-  printToken(yychar,tokenString);
-  Error = TRUE;
+  printToken(lastToken,tokenText());
+  Error++;
   return 0;
 }
 
 /* yylex calls getToken to make Yacc/Bison output
- * compatible with ealier versions of the TINY scanner
+ * compatible with ealier versions of the TINY scanner;
+ * with a token buffer it just advances an index
  */
-static int yylex(void)
-{ return getToken(); }
+static int yylex(YYSTYPE * lvalp)
+{ (void) lvalp;
+  lastToken = tokens != NULL ? replayToken(tokens) :
+              tokenSource != NULL ? tokenSource() : getToken();
+  return lastToken; }
 
 TreeNode * parse(void)
-{ yyparse();
+{ tokens = NULL;
+  yyparse();
   return savedTree;
 }
 
+TreeNode * parseBuffer(TokenBuffer * tb)
+{ tokens = tb;
+  yyparse();
+  tokens = NULL;
+  return savedTree;
+}
+
+int parseStream(TokenSource src, DeclProc proc)
+{ int ok;
+  tokens = NULL;
+  tokenSource = src;
+  declProc = proc;
+  ok = yyparse() == 0;
+  tokenSource = NULL;
+  declProc = NULL;
+  savedTree = NULL;
+  return ok;
+}
+
+TreeNode * parseRange(long start, long end, int line, int * ok)
+{ TreeNode * t;
+  tokens = NULL;
+  quiet = TRUE;
+  savedTree = NULL;
+  scanRange(start, end, line);
+  *ok = yyparse() == 0;
+  quiet = FALSE;
+  t = savedTree;
+  savedTree = NULL;
+  return t;
+}
+
@@ -10,21 +10,26 @@
 #include <time.h>
 #include "code.h"
 
+/* the code of the top-level declaration being
+ * generated on this thread
+ */
+THREAD_LOCAL FILE * unitCode;
+
 /* TM location number for current instruction emission */
-static int emitLoc = 0;
+static THREAD_LOCAL int emitLoc = 0;
 
 /* Highest TM location emitted so far
    For use in conjunction with emitSkip,
    emitBackup, and emitRestore */
-static int highEmitLoc = 0;
+static THREAD_LOCAL int highEmitLoc = 0;
 
-static int highRegisterNumber = 0;
+static THREAD_LOCAL int highRegisterNumber = 0;
 
-static int registerNumber = 0;
+static THREAD_LOCAL int registerNumber = 0;
 
-static int subRoutineLevel = 0;
+static THREAD_LOCAL int subRoutineLevel = 0;
 
-static int deviationLevel = 0;
+static THREAD_LOCAL int deviationLevel = 0;
 
 /* Procedure emitComment prints a comment line
  * with comment c in the code file
@@ -33,7 +38,7 @@ void printSubRoutine()
 {
   for (int i = 0; i < subRoutineLevel; i++)
   {
-    fprintf(code, "\t");
+    fprintf(unitCode, "\t");
   }
 }
 
@@ -42,7 +47,7 @@ void emitComment(char *c)
   if (TraceCode)
   {
     printSubRoutine();
-    fprintf(code, "* %s\n", c);
+    fprintf(unitCode, "* %s\n", c);
   }
 }
 
@@ -149,7 +154,7 @@ void emitCommentWithLine(char *c, int line)
   if (TraceCode)
   {
     printSubRoutine();
-    fprintf(code, "* %s line: %d\n", c, line);
+    fprintf(unitCode, "* %s line: %d\n", c, line);
   }
 }
 
@@ -158,10 +163,12 @@ void emitTimeOfCompilation()
   if (TraceCode)
   {
     time_t rawtime;
-    struct tm *timeinfo;
+    struct tm timeinfo;
+    char text[32];
+    /* the reentrant forms: several threads may compile at once */
     time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    fprintf(code, "* TIME OF COMPILATION: %s\n", asctime(timeinfo));
+    localtime_r(&rawtime, &timeinfo);
+    fprintf(unitCode, "* TIME OF COMPILATION: %s\n", asctime_r(&timeinfo, text));
   }
 }
 
@@ -179,14 +186,14 @@ void printDeviation()
 {
   for (int i = 0; i < deviationLevel; i++)
   {
-    fprintf(code, "\t");
+    fprintf(unitCode, "\t");
   }
 }
 
 void emitDeviationAssign()
 {
   printSubRoutine();
-  fprintf(code, " t%d = ", registerNumber);
+  fprintf(unitCode, " " TEMP " = ", registerNumber);
 
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
@@ -197,7 +204,7 @@ void emitDeviationAssign()
 void emitIf()
 {
   printSubRoutine();
-  fprintf(code, "if_true t%d goto L%d \n", registerNumber - 1, deviationLevel);
+  fprintf(unitCode, "if_true " TEMP " goto " LABEL " \n", registerNumber - 1, deviationLevel);
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
 }
@@ -205,7 +212,7 @@ void emitIf()
 void emitElse()
 {
   printSubRoutine();
-  fprintf(code, "goto L%d \n", deviationLevel + 1);
+  fprintf(unitCode, "goto " LABEL " \n", deviationLevel + 1);
 
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
@@ -214,7 +221,7 @@ void emitElse()
 void emitDeviation()
 {
   printSubRoutine();
-  fprintf(code, " L%d: \n", deviationLevel);
+  fprintf(unitCode, " " LABEL ": \n", deviationLevel);
   deviationLevel++;
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
@@ -223,7 +230,7 @@ void emitDeviation()
 void emitWhileDeviation()
 {
   printSubRoutine();
-  fprintf(code, "L%d: t%d = ", deviationLevel + 1, registerNumber);
+  fprintf(unitCode, LABEL ": " TEMP " = ", deviationLevel + 1, registerNumber);
 
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
@@ -234,7 +241,7 @@ void emitWhileDeviation()
 void emitWhile()
 {
   printSubRoutine();
-  fprintf(code, "if_true t%d goto L%d \n", registerNumber - 1, deviationLevel + 1);
+  fprintf(unitCode, "if_true " TEMP " goto " LABEL " \n", registerNumber - 1, deviationLevel + 1);
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
   deviationLevel++;
@@ -243,10 +250,10 @@ void emitWhile()
 void emitEndWhile()
 {
   printSubRoutine();
-  fprintf(code, "goto L%d \n", deviationLevel - 1);
+  fprintf(unitCode, "goto " LABEL " \n", deviationLevel - 1);
 
   printSubRoutine();
-  fprintf(code, "L%d:\n", deviationLevel);
+  fprintf(unitCode, LABEL ":\n", deviationLevel);
 
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
@@ -331,10 +338,10 @@ char *getOpOpositeChar(TreeNode *tree)
 void emitRO(char *op, int r, int s, int t, char *c)
 {
   printSubRoutine();
-  fprintf(code, " %5s  %d,%d,%d ", op, r, s, t);
+  fprintf(unitCode, " %5s  %d,%d,%d ", op, r, s, t);
   if (TraceCode)
-    fprintf(code, "\t%s", c);
-  fprintf(code, "\n");
+    fprintf(unitCode, "\t%s", c);
+  fprintf(unitCode, "\n");
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
 } /* emitRO */
@@ -350,10 +357,10 @@ void emitRO(char *op, int r, int s, int t, char *c)
 void emitRM(char *op, int r, int s, char *c)
 {
   printSubRoutine();
-  fprintf(code, " %5s  %d(%d) ", op, r, s);
+  fprintf(unitCode, " %5s  %d(%d) ", op, r, s);
   if (TraceCode)
-    fprintf(code, "\t%s", c);
-  fprintf(code, "\n");
+    fprintf(unitCode, "\t%s", c);
+  fprintf(unitCode, "\n");
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
 } /* emitRM */
@@ -361,7 +368,7 @@ void emitRM(char *op, int r, int s, char *c)
 void emitOpAssign(char *op)
 {
   printSubRoutine();
-  fprintf(code, "t%d = ", registerNumber);
+  fprintf(unitCode, TEMP " = ", registerNumber);
 
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
@@ -377,20 +384,20 @@ void emitAssign()
 
 void emitArrayAssign(TreeNode *tree)
 {
-  fprintf(code, "t%d = ", registerNumber);
+  fprintf(unitCode, TEMP " = ", registerNumber);
 
   if (tree->child[0]->kind.exp == IdK)
   {
-    fprintf(code, "%s", tree->child[0]->attr.name);
+    fprintf(unitCode, "%s", tree->child[0]->attr.name);
   }
   else if (tree->child[0]->kind.exp == ConstK)
   {
-    fprintf(code, "%d", tree->child[0]->attr.val);
+    fprintf(unitCode, "%d", tree->child[0]->attr.val);
   }
 
-  fprintf(code, " * 4 \n");
+  fprintf(unitCode, " * 4 \n");
   printSubRoutine();
-  fprintf(code, "%s[t%d] = ", tree->attr.name, registerNumber);
+  fprintf(unitCode, "%s[" TEMP "] = ", tree->attr.name, registerNumber);
   registerNumber++;
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
@@ -399,18 +406,18 @@ void emitArrayAssign(TreeNode *tree)
 void emitArrayAtribution(TreeNode *tree)
 {
   printSubRoutine();
-  fprintf(code, "t%d = ", registerNumber);
+  fprintf(unitCode, TEMP " = ", registerNumber);
 
   if (tree->child[0]->kind.exp == IdK)
   {
-    fprintf(code, "%s", tree->child[0]->attr.name);
+    fprintf(unitCode, "%s", tree->child[0]->attr.name);
   }
   else if (tree->child[0]->kind.exp == ConstK)
   {
-    fprintf(code, "%d", tree->child[0]->attr.val);
+    fprintf(unitCode, "%d", tree->child[0]->attr.val);
   }
 
-  fprintf(code, " * 4 \n");
+  fprintf(unitCode, " * 4 \n");
   registerNumber++;
   if (highEmitLoc < emitLoc)
     highEmitLoc = emitLoc;
@@ -422,6 +429,21 @@ int getRegisterNumber()
   return registerNumber;
 }
 
+/* Procedure resetNumbers numbers the temps and
+ * labels of this thread from 0 again
+ */
+void resetNumbers(void)
+{
+  registerNumber = 0;
+  deviationLevel = 0;
+  emitLoc = highEmitLoc = 0;
+}
+
+int getDeviationLevel(void)
+{
+  return deviationLevel;
+}
+
 int printNumParams(TreeNode *tree)
 {
   TreeNode *p;
@@ -431,10 +453,10 @@ int printNumParams(TreeNode *tree)
   {
     printSubRoutine();
     if (p->kind.exp == ConstK) {
-      fprintf(code, "param %d\n", p->attr.val);
+      fprintf(unitCode, "param %d\n", p->attr.val);
     }
     else {
-      fprintf(code, "param %s\n", p->attr.name);
+      fprintf(unitCode, "param %s\n", p->attr.name);
     }
     
 
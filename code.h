@@ -29,6 +29,21 @@
 /* 2nd accumulator */
 #define ac1 1
 
+/* unitCode is the file the code of the top-level
+ * declaration being generated on this thread goes
+ * to (see codeGenUnit)
+ */
+extern THREAD_LOCAL FILE * unitCode;
+
+/* TEMP and LABEL print the number of a temp and
+ * of a label. In the code of a top-level
+ * declaration they are numbered from 0 after a
+ * mark, which codeGenPlace replaces by adding the
+ * temps or the labels of the declarations before
+ */
+#define TEMP "t\001%d"
+#define LABEL "L\002%d"
+
 /* code emitting utilities */
 
 /* Procedure emitComment prints a comment line
@@ -84,6 +99,10 @@ void emitOpAssign(char *op);
 
 int getRegisterNumber(void);
 
+int getDeviationLevel(void);
+
+void resetNumbers(void);
+
 void emitAssign(void);
 
 void increaseSubroutineLevel();
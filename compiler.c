@@ -0,0 +1,198 @@
+/****************************************************/
+/* File: compiler.c                                 */
+/* The CMINUS compiler as a library, libcminus,     */
+/* and the globals of the compiler                  */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <pthread.h>
+#include "util.h"
+#include "arena.h"
+#include "intern.h"
+#include "scan.h"
+#include "hashcons.h"
+#include "tokbuf.h"
+#include "parse.h"
+#include "analyze.h"
+#include "symtab.h"
+#include "cgen.h"
+#include "compiler.h"
+
+/* allocate global variables */
+THREAD_LOCAL int lineno = 0;
+THREAD_LOCAL FILE * source;
+THREAD_LOCAL const char * sourceText;
+THREAD_LOCAL long sourceLen;
+THREAD_LOCAL FILE * listing;
+THREAD_LOCAL FILE * code;
+
+/* allocate and set tracing flags */
+THREAD_LOCAL int EchoSource = FALSE;
+THREAD_LOCAL int TraceScan = FALSE;
+THREAD_LOCAL int TraceParse = FALSE;
+THREAD_LOCAL int TraceAnalyze = TRUE;
+THREAD_LOCAL int TraceCode = FALSE;
+
+/* scanner selection, see globals.h */
+THREAD_LOCAL int FlexScan = FALSE;
+
+/* expression sharing, see globals.h */
+THREAD_LOCAL int HashCons = FALSE;
+
+// // Intermediate code
+// int EchoSource = FALSE;
+// int TraceScan = FALSE;
+// int TraceParse = FALSE;
+// int TraceAnalyze = FALSE;
+// int TraceCode = TRUE;
+// // Semantic
+// int EchoSource = FALSE;
+// int TraceScan = FALSE;
+// int TraceParse = FALSE;
+// int TraceAnalyze = TRUE;
+// int TraceCode = FALSE;
+
+// // Syntax
+// int EchoSource = FALSE;
+// int TraceScan = FALSE;
+// int TraceParse = TRUE;
+// int TraceAnalyze = FALSE;
+// int TraceCode = FALSE;
+
+
+THREAD_LOCAL int Error = FALSE;
+
+struct CompilerRec
+   { int options;
+     Arena arena;       /* the tree and symbols of a compilation */
+     char * code;       /* the code of the last compilation */
+     size_t codeSize;
+     char * diagnostics; /* its listing */
+     size_t diagnosticsSize;
+     int errors;
+   };
+
+/* the names the compiler refers to are interned
+ * once for all the compilers of the process
+ */
+static pthread_once_t namesOnce = PTHREAD_ONCE_INIT;
+
+Compiler newCompiler(int options)
+{ Compiler c = (Compiler) calloc(1, sizeof(struct CompilerRec));
+  if (c == NULL) return NULL;
+  c->options = options;
+  return c;
+}
+
+/* Procedure clearResults frees the code and the
+ * diagnostics of the last compilation of c
+ */
+static void clearResults(Compiler c)
+{ free(c->code);
+  free(c->diagnostics);
+  c->code = c->diagnostics = NULL;
+  c->codeSize = c->diagnosticsSize = 0;
+  c->errors = 0;
+}
+
+/* Procedure setGlobals sets the globals of the
+ * calling thread for a compilation of the len
+ * bytes at text with the options of c
+ */
+static void setGlobals(Compiler c, const char * text, long len)
+{ source = NULL;
+  sourceText = text;
+  sourceLen = len;
+  EchoSource = (c->options & CM_ECHO_SOURCE) != 0;
+  TraceScan = (c->options & CM_TRACE_SCAN) != 0;
+  TraceParse = (c->options & CM_TRACE_PARSE) != 0;
+  TraceAnalyze = (c->options & CM_TRACE_ANALYZE) != 0;
+  TraceCode = (c->options & CM_TRACE_CODE) != 0;
+  FlexScan = FALSE; /* the flex scanner is not reentrant */
+  HashCons = (c->options & CM_HASH_CONS) != 0;
+  Error = FALSE;
+  lineno = 0;
+}
+
+/* Function compileBuffer compiles as the command
+ * line compiler does, but for the parallel and
+ * streaming modes, with the listing and the code
+ * going to memory. Everything it changes is state
+ * of the calling thread: its globals, its arena
+ * and its own symbol table, which are restored or
+ * freed when it returns.
+ */
+int compileBuffer(Compiler c, const char * name,
+                  const char * text, long len)
+{ Globals saved;
+  Arena * savedArena = currentArena;
+  TreeNode * syntaxTree;
+  int ok;
+  pthread_once(&namesOnce, initNames);
+  clearResults(c);
+  saveGlobals(&saved);
+  setGlobals(c, text, len);
+  listing = open_memstream(&c->diagnostics, &c->diagnosticsSize);
+  code = open_memstream(&c->code, &c->codeSize);
+  if (listing == NULL || code == NULL)
+  { if (listing != NULL) fclose(listing);
+    if (code != NULL) fclose(code);
+    loadGlobals(&saved);
+    clearResults(c);
+    c->errors = 1;
+    return 0;
+  }
+  currentArena = &c->arena;
+  resetScanner();
+  consReset();
+  st_beginThread();
+  syntaxTree = parse();
+  if (TraceParse) {
+    fprintf(listing,"\nSyntax tree:\n");
+    printTree(syntaxTree);
+  }
+  if (! Error)
+  { if (TraceAnalyze) fprintf(listing,"\nBuilding Symbol Table...\n");
+    buildSymtab(syntaxTree);
+    if (TraceAnalyze) fprintf(listing,"\nChecking Types...\n");
+    typeCheck(syntaxTree);
+    if (TraceAnalyze) fprintf(listing,"\nType Checking Finished\n");
+  }
+  if (! Error && ! (c->options & CM_CHECK_ONLY)) codeGen(syntaxTree, (char *) name);
+  st_endThread();
+  arenaRelease(&c->arena);
+  currentArena = savedArena;
+  fclose(listing);
+  fclose(code);
+  c->errors = Error;
+  ok = ! Error;
+  /* as the command line compiler, no code is left after an error */
+  if (! ok)
+  { c->code[0] = '\0';
+    c->codeSize = 0;
+  }
+  loadGlobals(&saved);
+  return ok;
+}
+
+const char * compilerCode(Compiler c, size_t * size)
+{ if (size != NULL) *size = c->codeSize;
+  return c->code != NULL ? c->code : "";
+}
+
+const char * compilerDiagnostics(Compiler c, size_t * size)
+{ if (size != NULL) *size = c->diagnosticsSize;
+  return c->diagnostics != NULL ? c->diagnostics : "";
+}
+
+int compilerErrors(Compiler c)
+{ return c->errors;
+}
+
+void freeCompiler(Compiler c)
+{ if (c == NULL) return;
+  clearResults(c);
+  free(c);
+}
@@ -0,0 +1,74 @@
+/****************************************************/
+/* File: compiler.h                                 */
+/* The CMINUS compiler as a library, libcminus:     */
+/* compiles a source buffer to a code buffer        */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _COMPILER_H_
+#define _COMPILER_H_
+
+#include <stddef.h>
+
+/* options of a compiler, or'ed together; they
+ * stand for the flags of globals.h, for
+ * --hash-cons and for a check without code
+ */
+#define CM_HASH_CONS     0x01 /* share equal expressions */
+#define CM_TRACE_ANALYZE 0x02 /* list the symbol table */
+#define CM_TRACE_PARSE   0x04 /* print the syntax tree */
+#define CM_TRACE_SCAN    0x08 /* print the tokens */
+#define CM_TRACE_CODE    0x10 /* comment the code */
+#define CM_ECHO_SOURCE   0x20
+#define CM_CHECK_ONLY    0x40 /* stop after type checking */
+
+/* a compiler, with the code and the diagnostics
+ * of the last source it compiled. A compiler is
+ * used by one thread at a time; compilers on
+ * different threads compile at the same time.
+ */
+typedef struct CompilerRec * Compiler;
+
+/* Function newCompiler returns a compiler with
+ * the given options, or NULL if out of memory
+ */
+Compiler newCompiler(int options);
+
+/* Function compileBuffer compiles the len bytes
+ * of C-minus source at text, which need not end
+ * in a NUL, on the calling thread; name is the
+ * file name the code is marked with. The code and
+ * the diagnostics of an earlier compilation are
+ * dropped. Returns 1 if the source has no errors,
+ * in which case the code is that the command
+ * line compiler would write, and 0 otherwise,
+ * leaving no code.
+ */
+int compileBuffer(Compiler c, const char * name,
+                  const char * text, long len);
+
+/* Function compilerCode returns the code of the
+ * last compilation, NUL terminated, and its
+ * length in *size if size is not NULL. It stays
+ * valid until the next compilation.
+ */
+const char * compilerCode(Compiler c, size_t * size);
+
+/* Function compilerDiagnostics returns what the
+ * last compilation printed to the listing file:
+ * its errors and the traces of its options
+ */
+const char * compilerDiagnostics(Compiler c, size_t * size);
+
+/* Function compilerErrors returns the number of
+ * errors the last compilation reported
+ */
+int compilerErrors(Compiler c);
+
+/* Procedure freeCompiler frees c with its code
+ * and diagnostics
+ */
+void freeCompiler(Compiler c);
+
+#endif
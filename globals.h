@@ -15,27 +15,6 @@
 #include <ctype.h>
 #include <string.h>
 
-/* Yacc/Bison generates internally its own values
- * for the tokens. Other files can access these values
- * by including the tab.h file generated using the
- * Yacc/Bison option -d ("generate header")
- *
- * The YYPARSER flag prevents inclusion of the tab.h
- * into the Yacc/Bison output itself
- */
-
-#ifndef YYPARSER
-
-/* the name of the following file may change */
-#include "cminus.tab.h"
-
-/* ENDFILE is implicitly defined by Yacc/Bison,
- * and not included in the tab.h file
- */
-#define ENDFILE 0
-
-#endif
-
 #ifndef FALSE
 #define FALSE 0
 #endif
@@ -44,6 +23,17 @@
 #define TRUE 1
 #endif
 
+/* THREAD_LOCAL marks compiler state of which
+ * every thread keeps its own copy, so that
+ * several threads can scan and parse at once,
+ * and several compilations run at once on
+ * threads of their own (see compiler.h). A
+ * thread that helps with the compilation of
+ * another takes a copy of its globals with
+ * loadGlobals (see util.h).
+ */
+#define THREAD_LOCAL _Thread_local
+
 /* MAXRESERVED = the number of reserved words */
 #define MAXRESERVED 8
 
@@ -52,11 +42,13 @@
  */
 typedef int TokenType;
 
-extern FILE* source; /* source code text file */
-extern FILE* listing; /* listing output text file */
-extern FILE* code; /* code text file for TM simulator */
+extern THREAD_LOCAL FILE* source; /* source code text file */
+extern THREAD_LOCAL const char * sourceText; /* source file mapped into memory */
+extern THREAD_LOCAL long sourceLen; /* number of bytes in sourceText */
+extern THREAD_LOCAL FILE* listing; /* listing output text file */
+extern THREAD_LOCAL FILE* code; /* code text file for TM simulator */
 
-extern int lineno; /* source line number for listing */
+extern THREAD_LOCAL int lineno; /* source line number for listing */
 
 /**************************************************/
 /***********   Syntax tree for parsing ************/
@@ -81,8 +73,43 @@ typedef struct treeNode
              int val;
              char * name; } attr;
      ExpType type; /* for type checking of exps */
+     int consed; /* TRUE if hash-consed: it may have several parents */
    } TreeNode;
 
+/* NodeList is a sibling chain together with its
+ * last node, so that nodes are appended in
+ * constant time while parsing
+ */
+typedef struct
+   { TreeNode * head;
+     TreeNode * tail;
+   } NodeList;
+
+/* Yacc/Bison generates internally its own values
+ * for the tokens. Other files can access these values
+ * by including the tab.h file generated using the
+ * Yacc/Bison option -d ("generate header")
+ *
+ * The YYPARSER flag prevents inclusion of the tab.h
+ * into the Yacc/Bison output itself
+ *
+ * The tab.h file declares the semantic values of
+ * the parser in terms of TreeNode, so it is
+ * included after the syntax tree types
+ */
+
+#ifndef YYPARSER
+
+/* the name of the following file may change */
+#include "cminus.tab.h"
+
+/* ENDFILE is implicitly defined by Yacc/Bison,
+ * and not included in the tab.h file
+ */
+#define ENDFILE 0
+
+#endif
+
 /**************************************************/
 /***********   Flags for tracing       ************/
 /**************************************************/
@@ -91,30 +118,42 @@ typedef struct treeNode
  * be echoed to the listing file with line numbers
  * during parsing
  */
-extern int EchoSource;
+extern THREAD_LOCAL int EchoSource;
 
 /* TraceScan = TRUE causes token information to be
  * printed to the listing file as each token is
  * recognized by the scanner
  */
-extern int TraceScan;
+extern THREAD_LOCAL int TraceScan;
 
 /* TraceParse = TRUE causes the syntax tree to be
  * printed to the listing file in linearized form
  * (using indents for children)
  */
-extern int TraceParse;
+extern THREAD_LOCAL int TraceParse;
 
 /* TraceAnalyze = TRUE causes symbol table inserts
  * and lookups to be reported to the listing file
  */
-extern int TraceAnalyze;
+extern THREAD_LOCAL int TraceAnalyze;
 
 /* TraceCode = TRUE causes comments to be written
  * to the TM code file as code is generated
  */
-extern int TraceCode;
+extern THREAD_LOCAL int TraceCode;
+
+/* FlexScan = TRUE selects the flex-generated scanner
+ * of cminus.l instead of the hand-written DFA scanner
+ */
+extern THREAD_LOCAL int FlexScan;
 
-/* Error = TRUE prevents further passes if an error occurs */
-extern int Error;
+/* HashCons = TRUE makes equal expressions share
+ * one node while parsing (see hashcons.h)
+ */
+extern THREAD_LOCAL int HashCons;
+
+/* Error counts the errors reported; once it is
+ * not 0, no further passes are run
+ */
+extern THREAD_LOCAL int Error;
 #endif
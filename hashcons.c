@@ -0,0 +1,168 @@
+/****************************************************/
+/* File: hashcons.c                                 */
+/* Hash-consing of expression nodes for the CMINUS  */
+/* compiler                                         */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "util.h"
+#include "hashcons.h"
+
+/* the nodes built so far, in an open addressing
+ * table. A slot is in use only if its epoch is the
+ * current one, so consReset empties the table in
+ * constant time.
+ */
+typedef struct
+   { TreeNode * node;
+     unsigned epoch;
+   } ConsSlot;
+
+static THREAD_LOCAL ConsSlot * table;
+static THREAD_LOCAL int size;    /* number of slots, a power of two */
+static THREAD_LOCAL int count;   /* slots in use */
+static THREAD_LOCAL unsigned epoch = 1;
+
+/* the key of a node: its kind, attribute and
+ * children. OpK nodes also keep their line, since
+ * type errors report it; the analysis treats all
+ * equal IdK and ConstK nodes alike.
+ */
+static unsigned long long keyHash(ExpKind kind, long attr,
+                                  TreeNode * c0, TreeNode * c1, int line)
+{ unsigned long long h = (unsigned long long) kind * 0x9E3779B97F4A7C15ULL;
+  h = (h ^ (unsigned long long) attr) * 0xFF51AFD7ED558CCDULL;
+  h = (h ^ (unsigned long long) (size_t) c0) * 0xC4CEB9FE1A85EC53ULL;
+  h = (h ^ (unsigned long long) (size_t) c1) * 0x9E3779B97F4A7C15ULL;
+  h = (h ^ (unsigned long long) line) * 0xFF51AFD7ED558CCDULL;
+  return h ^ (h >> 32);
+}
+
+static long nodeAttr(TreeNode * t)
+{ switch (t->kind.exp)
+  { case OpK: return t->attr.op;
+    case ConstK: return t->attr.val;
+    default: return (long) (size_t) t->attr.name;
+  }
+}
+
+static unsigned long long nodeHash(TreeNode * t)
+{ return keyHash(t->kind.exp, nodeAttr(t), t->child[0], t->child[1],
+                 t->kind.exp == OpK ? t->lineno : 0);
+}
+
+/* Procedure growTable doubles the slots of the
+ * table, keeping the nodes of the current epoch
+ */
+static void growTable(void)
+{ int newSize = size ? size * 2 : 1024;
+  ConsSlot * slots = (ConsSlot *) calloc(newSize, sizeof(ConsSlot));
+  int i;
+  if (slots == NULL)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    exit(1);
+  }
+  for (i = 0; i < size; i++)
+    if (table[i].epoch == epoch)
+    { int h = (int) (nodeHash(table[i].node) & (newSize - 1));
+      while (slots[h].epoch == epoch) h = (h + 1) & (newSize - 1);
+      slots[h] = table[i];
+    }
+  free(table);
+  table = slots;
+  size = newSize;
+}
+
+/* Function cons returns the node with the given
+ * key, building it with newExpNode if there is none
+ */
+static TreeNode * cons(ExpKind kind, long attr, TreeNode * c0,
+                       TreeNode * c1, int line)
+{ unsigned long long h;
+  TreeNode * t;
+  int i;
+  if (2 * (count + 1) > size) growTable();
+  h = keyHash(kind, attr, c0, c1, kind == OpK ? line : 0);
+  i = (int) (h & (size - 1));
+  while (table[i].epoch == epoch)
+  { t = table[i].node;
+    if (t->kind.exp == kind && nodeAttr(t) == attr &&
+        t->child[0] == c0 && t->child[1] == c1 &&
+        (kind != OpK || t->lineno == line))
+      return t;
+    i = (i + 1) & (size - 1);
+  }
+  t = newExpNode(kind);
+  t->child[0] = c0;
+  t->child[1] = c1;
+  t->lineno = line;
+  t->consed = TRUE;
+  table[i].node = t;
+  table[i].epoch = epoch;
+  count++;
+  return t;
+}
+
+/* Function consOp returns an OpK node applying
+ * op to left and right
+ */
+TreeNode * consOp(TokenType op, TreeNode * left, TreeNode * right)
+{ TreeNode * t;
+  if (HashCons) t = cons(OpK, op, left, right, lineno);
+  else
+  { t = newExpNode(OpK);
+    t->child[0] = left;
+    t->child[1] = right;
+  }
+  t->attr.op = op;
+  return t;
+}
+
+/* Function consId returns an IdK node for name,
+ * indexed by index if it is not NULL
+ */
+TreeNode * consId(char * name, TreeNode * index, int line)
+{ TreeNode * t;
+  if (HashCons) t = cons(IdK, (long) (size_t) name, index, NULL, line);
+  else
+  { t = newExpNode(IdK);
+    t->child[0] = index;
+    t->lineno = line;
+  }
+  t->attr.name = name;
+  return t;
+}
+
+/* Function consConst returns a ConstK node of value val */
+TreeNode * consConst(int val)
+{ TreeNode * t;
+  if (HashCons) t = cons(ConstK, val, NULL, NULL, lineno);
+  else t = newExpNode(ConstK);
+  t->attr.val = val;
+  return t;
+}
+
+/* Function unshareNode returns t, or a copy of it
+ * if t may have other parents; it is used before
+ * a node is linked into a sibling list
+ */
+TreeNode * unshareNode(TreeNode * t)
+{ TreeNode * c;
+  if (t == NULL || !t->consed) return t;
+  c = newExpNode(t->kind.exp);
+  *c = *t;
+  c->consed = FALSE;
+  return c;
+}
+
+/* Procedure consReset forgets the nodes built so
+ * far on this thread; it is called at the start of
+ * each function, so that nodes are only shared
+ * within a function
+ */
+void consReset(void)
+{ epoch++;
+  count = 0;
+}
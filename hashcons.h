@@ -0,0 +1,39 @@
+/****************************************************/
+/* File: hashcons.h                                 */
+/* Hash-consing of expression nodes for the CMINUS  */
+/* compiler: with HashCons set, equal subexpressions */
+/* share one node and the syntax tree is a DAG      */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _HASHCONS_H_
+#define _HASHCONS_H_
+
+/* Function consOp returns an OpK node applying
+ * op to left and right
+ */
+TreeNode * consOp(TokenType op, TreeNode * left, TreeNode * right);
+
+/* Function consId returns an IdK node for name,
+ * indexed by index if it is not NULL
+ */
+TreeNode * consId(char * name, TreeNode * index, int line);
+
+/* Function consConst returns a ConstK node of value val */
+TreeNode * consConst(int val);
+
+/* Function unshareNode returns t, or a copy of it
+ * if t may have other parents; it is used before
+ * a node is linked into a sibling list
+ */
+TreeNode * unshareNode(TreeNode * t);
+
+/* Procedure consReset forgets the nodes built so
+ * far on this thread; it is called at the start of
+ * each function, so that nodes are only shared
+ * within a function
+ */
+void consReset(void);
+
+#endif
@@ -0,0 +1,170 @@
+/****************************************************/
+/* File: intern.c                                   */
+/* Identifier intern table implementation for the   */
+/* CMINUS compiler                                  */
+/* The table is split into shards, each with its    */
+/* own lock, open addressing slots and storage      */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <stddef.h>
+#include <pthread.h>
+#include "intern.h"
+
+/* SHARDBITS = log2 of the number of shards; the
+ * shard of a name is given by the top bits of its hash
+ */
+#define SHARDBITS 6
+#define SHARDS (1 << SHARDBITS)
+
+/* BLOCKSIZE is the size of the storage blocks
+ * names are carved from
+ */
+#define BLOCKSIZE 65536
+
+/* an interned name: the text follows the
+ * cached hash, so the name pointer handed out
+ * is the address of text
+ */
+typedef struct
+   { unsigned long long hash;
+     int len;
+     char text[1];
+   } NameRec;
+
+typedef struct
+   { pthread_mutex_t lock;
+     NameRec ** slot; /* open addressing table */
+     int size;        /* number of slots, a power of two */
+     int count;       /* number of names */
+     char * block;    /* storage for new names */
+     size_t left;     /* bytes left in block */
+   } Shard;
+
+static Shard shards[SHARDS];
+static pthread_once_t shardsOnce = PTHREAD_ONCE_INIT;
+
+char * nameGlobal;
+char * nameMain;
+char * nameInput;
+char * nameOutput;
+char * nameInt;
+char * nameVoid;
+
+static void initShards(void)
+{ int i;
+  for (i = 0; i < SHARDS; i++)
+    pthread_mutex_init(&shards[i].lock, NULL);
+}
+
+/* Function textHash returns the FNV-1a hash of
+ * the n bytes at s
+ */
+unsigned long long textHash(const char * s, long n)
+{ unsigned long long h = 14695981039346656037ULL;
+  long i;
+  for (i = 0; i < n; i++)
+    h = (h ^ (unsigned char) s[i]) * 1099511628211ULL;
+  return h;
+}
+
+/* Procedure growShard doubles the slots of a shard */
+static void growShard(Shard * sh)
+{ int size = sh->size ? sh->size * 2 : 64;
+  NameRec ** slot = (NameRec **) calloc(size, sizeof(NameRec *));
+  int i;
+  if (slot == NULL)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    exit(1);
+  }
+  for (i = 0; i < sh->size; i++)
+    if (sh->slot[i] != NULL)
+    { int h = (int) (sh->slot[i]->hash & (size - 1));
+      while (slot[h] != NULL) h = (h + 1) & (size - 1);
+      slot[h] = sh->slot[i];
+    }
+  free(sh->slot);
+  sh->slot = slot;
+  sh->size = size;
+}
+
+/* Function newName copies a name into the
+ * storage of a shard
+ */
+static NameRec * newName(Shard * sh, const char * s, int n, unsigned long long h)
+{ size_t need = (offsetof(NameRec, text) + n + 1 + 7) & ~(size_t) 7;
+  NameRec * r;
+  if (need > sh->left)
+  { size_t size = need > BLOCKSIZE ? need : BLOCKSIZE;
+    sh->block = (char *) malloc(size);
+    if (sh->block == NULL)
+    { fprintf(listing,"Out of memory error at line %d\n",lineno);
+      exit(1);
+    }
+    sh->left = size;
+  }
+  r = (NameRec *) sh->block;
+  sh->block += need;
+  sh->left -= need;
+  r->hash = h;
+  r->len = n;
+  memcpy(r->text, s, n);
+  r->text[n] = '\0';
+  return r;
+}
+
+/* Function internName returns the canonical copy
+ * of the n characters at s, entering it in the
+ * table if it is new. It may be called from
+ * several threads at once.
+ */
+char * internName(const char * s, int n)
+{ unsigned long long h = textHash(s, n);
+  Shard * sh = &shards[h >> (64 - SHARDBITS)];
+  NameRec * r;
+  int i;
+  pthread_once(&shardsOnce, initShards);
+  pthread_mutex_lock(&sh->lock);
+  if (2 * (sh->count + 1) > sh->size) growShard(sh);
+  i = (int) (h & (sh->size - 1));
+  while ((r = sh->slot[i]) != NULL)
+  { if (r->hash == h && r->len == n && memcmp(r->text, s, n) == 0)
+    { pthread_mutex_unlock(&sh->lock);
+      return r->text;
+    }
+    i = (i + 1) & (sh->size - 1);
+  }
+  r = newName(sh, s, n, h);
+  sh->slot[i] = r;
+  sh->count++;
+  pthread_mutex_unlock(&sh->lock);
+  return r->text;
+}
+
+/* Function internString returns the canonical
+ * copy of the NUL terminated string s
+ */
+char * internString(const char * s)
+{ return internName(s, (int) strlen(s));
+}
+
+/* Function nameHash returns the 64-bit hash
+ * cached with an interned name
+ */
+unsigned long long nameHash(const char * name)
+{ return ((const NameRec *) (name - offsetof(NameRec, text)))->hash;
+}
+
+/* Procedure initNames interns the names the
+ * compiler itself refers to
+ */
+void initNames(void)
+{ nameGlobal = internString("global");
+  nameMain = internString("main");
+  nameInput = internString("input");
+  nameOutput = internString("output");
+  nameInt = internString("int");
+  nameVoid = internString("void");
+}
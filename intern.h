@@ -0,0 +1,48 @@
+/****************************************************/
+/* File: intern.h                                   */
+/* Identifier intern table for the CMINUS compiler  */
+/* Every distinct name has one canonical copy, so   */
+/* names are compared by pointer and their hash is  */
+/* computed only once                               */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _INTERN_H_
+#define _INTERN_H_
+
+/* Function internName returns the canonical copy
+ * of the n characters at s, entering it in the
+ * table if it is new. It may be called from
+ * several threads at once.
+ */
+char * internName(const char * s, int n);
+
+/* Function internString returns the canonical
+ * copy of the NUL terminated string s
+ */
+char * internString(const char * s);
+
+/* Function textHash returns the FNV-1a hash of
+ * the n bytes at s, the hash names are kept by
+ */
+unsigned long long textHash(const char * s, long n);
+
+/* Function nameHash returns the 64-bit hash
+ * cached with an interned name
+ */
+unsigned long long nameHash(const char * name);
+
+/* Interned names the compiler itself refers to;
+ * initNames must be called before they are used
+ */
+extern char * nameGlobal;
+extern char * nameMain;
+extern char * nameInput;
+extern char * nameOutput;
+extern char * nameInt;
+extern char * nameVoid;
+
+void initNames(void);
+
+#endif
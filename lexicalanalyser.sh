@@ -1,6 +1,6 @@
 flex cminus.l &&
-gcc -c lex.yy.c main.c util.c &&
-gcc -o cminus *.o -ll &&
+gcc -c lex.yy.c main.c compiler.c util.c scan.c bench.c tokbuf.c pparse.c intern.c arena.c ast.c hashcons.c pipeline.c pcompile.c xref.c batch.c serve.c watch.c &&
+gcc -o cminus *.o -ll -lpthread &&
 mkdir -p results &&
 ./cminus testfiles/mdc.c > results/mdc.txt &&
 ./cminus testfiles/sort.c > results/sort.txt
@@ -7,6 +7,9 @@
 
 #include "globals.h"
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 /* set NO_PARSE to TRUE to get a scanner-only compiler */
 #define NO_PARSE FALSE
@@ -26,70 +29,432 @@
 #define NO_CODE FALSE
 
 #include "util.h"
-#if NO_PARSE
+#include "arena.h"
+#include "intern.h"
+#include "bench.h"
+#include "tokbuf.h"
 #include "scan.h"
-#else
+#include "xref.h"
+#include "batch.h"
+#include "serve.h"
+#include "watch.h"
+#if !NO_PARSE
 #include "parse.h"
 #if !NO_ANALYZE
 #include "analyze.h"
+#include "symtab.h"
 #if !NO_CODE
 #include "cgen.h"
+#include "pipeline.h"
+#include "pcompile.h"
+#endif
+#endif
+#endif
+
+/* the global variables are allocated in compiler.c */
+
+/* Function mapSource maps the whole source file
+ * into memory; the scanner's tokens are spans of it
+ */
+static int mapSource(FILE * f)
+{ struct stat st;
+  void * p;
+  if (fstat(fileno(f), &st) != 0) return FALSE;
+  sourceLen = (long) st.st_size;
+  if (sourceLen == 0)
+  { sourceText = "";
+    return TRUE;
+  }
+  p = mmap(NULL, sourceLen, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+  if (p == MAP_FAILED) return FALSE;
+  madvise(p, sourceLen, MADV_SEQUENTIAL);
+  sourceText = (const char *) p;
+  return TRUE;
+}
+
+/* timePasses = TRUE reports the time spent
+ * in each pass of the compiler to stderr
+ */
+static int timePasses = FALSE;
+static struct timespec passStart;
+
+static void startPass(void)
+{ if (timePasses) clock_gettime(CLOCK_MONOTONIC, &passStart);
+}
+
+static void endPass(char * name)
+{ struct timespec now;
+  if (!timePasses) return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  fprintf(stderr,"%-12s %10.3f ms\n",name,
+          (now.tv_sec - passStart.tv_sec) * 1e3 +
+          (now.tv_nsec - passStart.tv_nsec) / 1e6);
+}
+
+/* the arena that owns the syntax tree, strings
+ * and symbol table of the compilation
+ */
+static Arena compilation;
+
+/* showStats = TRUE reports allocation counts
+ * to stderr when the compiler finishes
+ */
+static int showStats = FALSE;
+
+static void printStats(void)
+{ struct rusage ru;
+  if (!showStats) return;
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(stderr,"%-12s %10ld\n","nodes",compilation.nodes);
+  fprintf(stderr,"%-12s %10ld\n","node bytes",compilation.nodes * (long) sizeof(TreeNode));
+  fprintf(stderr,"%-12s %10ld\n","arena bytes",compilation.bytes);
+  fprintf(stderr,"%-12s %10ld\n","peak rss kB",ru.ru_maxrss);
+#if !NO_PARSE && !NO_ANALYZE
+  st_printStats(stderr);
 #endif
+}
+
+/* parseOnly = TRUE stops the compiler after parsing */
+static int parseOnly = FALSE;
+
+/* the cross-reference index the symbol table is
+ * merged into, or NULL
+ */
+static char * xrefPath = NULL;
+
+#if !NO_PARSE && !NO_ANALYZE
+/* Procedure saveXref merges the symbol table of
+ * source file pgm into the cross-reference index
+ */
+static void saveXref(char * pgm)
+{ if (xrefPath == NULL) return;
+  startPass();
+  if (!writeXref(xrefPath, pgm))
+    fprintf(stderr,"Unable to write %s\n",xrefPath);
+  endPass("xref");
+}
 #endif
+
+/* Function codeFileName returns the name of the
+ * code file for source file pgm
+ */
+static char * codeFileName(char * pgm)
+{ int fnlen = strcspn(pgm,".");
+  char * codefile = (char *) calloc(fnlen+4, sizeof(char));
+  strncpy(codefile,pgm,fnlen);
+  strcat(codefile,".tm");
+  return codefile;
+}
+
+#if !NO_PARSE && !NO_ANALYZE && !NO_CODE
+/* the arena of the top-level declaration being
+ * parsed in streaming mode
+ */
+static Arena declArena;
+
+/* Procedure compileDecl analyzes a top-level
+ * declaration and generates its code; symbols
+ * go to the current arena
+ */
+static void compileDecl(TreeNode * t)
+{ if (TraceParse) printTree(t);
+  if (! parseOnly)
+  { analyzeDecl(t);
+    if (! Error)
+    { codeGenDecl(t);
+      fflush(code);
+    }
+  }
+}
+
+/* Procedure streamDecl compiles a top-level
+ * declaration as soon as it is parsed, then
+ * releases its syntax tree. Symbols are kept in
+ * the compilation arena.
+ */
+static void streamDecl(TreeNode * t)
+{ currentArena = &compilation;
+  compileDecl(t);
+  currentArena = &declArena;
+  /* the nodes of the tree still count for --stats */
+  compilation.nodes += declArena.nodes;
+  arenaRelease(&declArena);
+}
+
+/* Procedure compileStream compiles the source
+ * file one top-level declaration at a time, so
+ * that memory is bounded by the largest function
+ * and code is written while the input is read.
+ * Code goes to stdout if the source is stdin.
+ * Semantic errors are reported as they are found,
+ * and code is written only up to the first error.
+ * If pipelined, the mapped source is scanned,
+ * parsed and compiled on three threads.
+ */
+static void compileStream(char * pgm, int pipelined)
+{ char * codefile = NULL;
+  int ok;
+  if (! pipelined) scanStream(source);
+  if (! parseOnly)
+  { if (source == stdin) code = stdout;
+    else
+    { codefile = codeFileName(pgm);
+      code = fopen(codefile,"w");
+      if (code == NULL)
+      { printf("Unable to open %s\n",codefile);
+        exit(1);
+      }
+    }
+    codeGenStart(codefile != NULL ? codefile : pgm);
+  }
+  if (TraceParse) fprintf(listing,"\nSyntax tree:\n");
+  if (TraceAnalyze && ! parseOnly) fprintf(listing,"\nBuilding Symbol Table...\n");
+  startAnalysis();
+  startPass();
+  if (pipelined)
+    ok = pipelineParse(compileDecl, &compilation, timePasses);
+  else
+  { currentArena = &declArena;
+    ok = parseStream(NULL, streamDecl);
+    currentArena = &compilation;
+    compilation.nodes += declArena.nodes;
+    arenaRelease(&declArena);
+  }
+  endPass(pipelined ? "pipeline" : "stream");
+  if (TraceAnalyze && ok && ! parseOnly)
+  { listSymtab();
+    fprintf(listing,"\nChecking Types...\n");
+    fprintf(listing,"\nType Checking Finished\n");
+  }
+  if (! parseOnly)
+  { codeGenEnd();
+    if (code != stdout)
+    { fclose(code);
+      /* as in batch mode, no code file is left after an error */
+      if (Error) remove(codefile);
+    }
+    else fflush(code);
+  }
+  free(codefile);
+}
 #endif
 
-/* allocate global variables */
-int lineno = 0;
-FILE * source;
-FILE * listing;
-FILE * code;
-
-/* allocate and set tracing flags */
-int EchoSource = FALSE;
-int TraceScan = FALSE;
-int TraceParse = FALSE;
-int TraceAnalyze = TRUE;
-int TraceCode = FALSE;
-
-// // Intermediate code
-// int EchoSource = FALSE;
-// int TraceScan = FALSE;
-// int TraceParse = FALSE;
-// int TraceAnalyze = FALSE;
-// int TraceCode = TRUE;
-// // Semantic
-// int EchoSource = FALSE;
-// int TraceScan = FALSE;
-// int TraceParse = FALSE;
-// int TraceAnalyze = TRUE;
-// int TraceCode = FALSE;
-
-// // Syntax
-// int EchoSource = FALSE;
-// int TraceScan = FALSE;
-// int TraceParse = TRUE;
-// int TraceAnalyze = FALSE;
-// int TraceCode = FALSE;
-
-
-int Error = FALSE;
+/* Function compileRemote has the compile server
+ * on path compile, or only check, the n files,
+ * printing their listings and writing their code
+ * as if they were compiled here; returns the
+ * number of files that could not be compiled
+ */
+static int compileRemote(char * path, char ** files, int n, int check)
+{ Connection c = connectServer(path);
+  int i, failed = 0;
+  if (c == NULL)
+  { fprintf(stderr,"Unable to connect to %s\n",path);
+    return n;
+  }
+  for (i = 0; i < n; i++)
+  { char * codefile = codeFileName(files[i]);
+    time_t rawtime;
+    struct tm timeinfo;
+    char stamp[32];
+    Reply r;
+    source = fopen(files[i],"r");
+    if (source == NULL || ! mapSource(source))
+    { fprintf(stderr,"File %s not found\n",files[i]);
+      if (source != NULL) fclose(source);
+      free(codefile);
+      failed++;
+      continue;
+    }
+    fclose(source);
+    time(&rawtime);
+    localtime_r(&rawtime, &timeinfo);
+    fprintf(listing,"\nCMINUS COMPILATION: %s\nTIME OF COMPILATION: %s",files[i],
+            asctime_r(&timeinfo, stamp));
+    if (! request(c, check, check ? files[i] : codefile, sourceText, sourceLen, &r))
+    { fprintf(stderr,"Lost the connection to %s\n",path);
+      if (sourceLen > 0) munmap((void *) sourceText, sourceLen);
+      free(codefile);
+      closeConnection(c);
+      return failed + n - i;
+    }
+    if (sourceLen > 0) munmap((void *) sourceText, sourceLen);
+    fwrite(r.diagnostics, 1, r.diagnosticsSize, listing);
+    if (! check)
+    { /* as after a compilation here, no code is left after an error */
+      FILE * f = r.errors == 0 ? fopen(codefile,"w") : NULL;
+      if (r.errors != 0) remove(codefile);
+      else if (f == NULL || fwrite(r.code, 1, r.codeSize, f) != r.codeSize)
+      { fprintf(stderr,"Unable to open %s\n",codefile);
+        failed++;
+      }
+      if (f != NULL) fclose(f);
+    }
+    freeReply(&r);
+    free(codefile);
+  }
+  closeConnection(c);
+  return failed;
+}
+
+static void usage(char * prog)
+{ fprintf(stderr,"usage: %s [--flex] [--tokenize-first] [--jobs <n>]\n"
+                 "       [--time-passes] [--parse-only] [--stats] [--hash-cons]\n"
+                 "       [--stream] [--pipeline] [--bench-scan <rounds>]\n"
+                 "       [--bench-ast <rounds>] [--bench-symtab <symbols>]\n"
+                 "       [--bench-compile <rounds>] [--xref <index>] <filename>|-\n"
+                 "       %s [options] [--jobs <n>] --out <dir> <file|dir>...\n"
+                 "       %s --watch <dir>\n"
+                 "       %s [options] --serve <socket>\n"
+                 "       %s --connect <socket> [--check] <file>...\n"
+                 "       %s --connect <socket> --bench-serve <rounds> <file>\n"
+                 "       %s [--time-passes] --def|--refs <index> <name>\n",
+          prog,prog,prog,prog,prog,prog,prog);
+  exit(1);
+}
 
 int main( int argc, char * argv[] )
 { TreeNode * syntaxTree;
   char pgm[120]; /* source code file name */
-  if (argc != 2)
-    { fprintf(stderr,"usage: %s <filename>\n",argv[0]);
+  int benchRounds = 0;
+  int astRounds = 0;
+  int symtabSymbols = 0;
+  int compileRounds = 0;
+  int serveRounds = 0;
+  int tokenizeFirst = FALSE;
+  int jobs = 0;
+  int stream = FALSE;
+  int pipelined = FALSE;
+  int parallel = FALSE;
+  char * queryPath = NULL;
+  char * outDir = NULL;
+  char * servePath = NULL;
+  char * connectPath = NULL;
+  char * watchDir = NULL;
+  int check = FALSE;
+  int queryRefs = FALSE;
+  TokenBuffer * tokens = NULL;
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+  { if (strcmp(argv[i],"--flex") == 0)
+      FlexScan = TRUE;
+    else if (strcmp(argv[i],"--tokenize-first") == 0)
+      tokenizeFirst = TRUE;
+    else if (strcmp(argv[i],"--jobs") == 0 && i + 1 < argc)
+      jobs = atoi(argv[++i]);
+    else if (strcmp(argv[i],"--time-passes") == 0)
+      timePasses = TRUE;
+    else if (strcmp(argv[i],"--parse-only") == 0)
+      parseOnly = TRUE;
+    else if (strcmp(argv[i],"--stats") == 0)
+      showStats = TRUE;
+    else if (strcmp(argv[i],"--hash-cons") == 0)
+      HashCons = TRUE;
+    else if (strcmp(argv[i],"--stream") == 0)
+      stream = TRUE;
+    else if (strcmp(argv[i],"--pipeline") == 0)
+      stream = pipelined = TRUE;
+    else if (strcmp(argv[i],"--bench-scan") == 0 && i + 1 < argc)
+      benchRounds = atoi(argv[++i]);
+    else if (strcmp(argv[i],"--bench-ast") == 0 && i + 1 < argc)
+      astRounds = atoi(argv[++i]);
+    else if (strcmp(argv[i],"--bench-symtab") == 0 && i + 1 < argc)
+      symtabSymbols = atoi(argv[++i]);
+    else if (strcmp(argv[i],"--bench-compile") == 0 && i + 1 < argc)
+      compileRounds = atoi(argv[++i]);
+    else if (strcmp(argv[i],"--out") == 0 && i + 1 < argc)
+      outDir = argv[++i];
+    else if (strcmp(argv[i],"--serve") == 0 && i + 1 < argc)
+      servePath = argv[++i];
+    else if (strcmp(argv[i],"--connect") == 0 && i + 1 < argc)
+      connectPath = argv[++i];
+    else if (strcmp(argv[i],"--watch") == 0 && i + 1 < argc)
+      watchDir = argv[++i];
+    else if (strcmp(argv[i],"--check") == 0)
+      check = TRUE;
+    else if (strcmp(argv[i],"--bench-serve") == 0 && i + 1 < argc)
+      serveRounds = atoi(argv[++i]);
+    else if (strcmp(argv[i],"--xref") == 0 && i + 1 < argc)
+      xrefPath = argv[++i];
+    else if ((strcmp(argv[i],"--def") == 0 || strcmp(argv[i],"--refs") == 0) && i + 1 < argc)
+    { queryRefs = strcmp(argv[i],"--refs") == 0;
+      queryPath = argv[++i];
+    }
+    else usage(argv[0]);
+  }
+  if (outDir != NULL && i < argc)
+  { listing = stdout;
+    if (FlexScan || stream || xrefPath != NULL)
+    { fprintf(stderr,"--out compiles with the compiler library, without --flex, --stream, --pipeline or --xref\n");
+      exit(1);
+    }
+    return compileBatch(argv + i, argc - i, outDir, jobs) > 0 ? 1 : 0;
+  }
+  if (watchDir != NULL && i == argc)
+  { listing = stdout;
+    if (FlexScan || stream || xrefPath != NULL || HashCons)
+    { fprintf(stderr,"--watch compiles without --flex, --stream, --pipeline, --xref or --hash-cons\n");
+      exit(1);
+    }
+    return watchDirectory(watchDir);
+  }
+  if (servePath != NULL && i == argc)
+  { if (FlexScan || stream || xrefPath != NULL)
+    { fprintf(stderr,"--serve compiles with the compiler library, without --flex, --stream, --pipeline or --xref\n");
+      exit(1);
+    }
+    return serve(servePath);
+  }
+  if (connectPath != NULL && serveRounds == 0 && i < argc)
+  { listing = stdout;
+    return compileRemote(connectPath, argv + i, argc - i, check) > 0 ? 1 : 0;
+  }
+  if (i != argc - 1 || (serveRounds > 0 && connectPath == NULL)) usage(argv[0]);
+  if (queryPath != NULL)
+  { int found;
+    listing = stdout;
+    startPass();
+    found = queryXref(queryPath, argv[i], queryRefs);
+    endPass("query");
+    if (found < 0)
+    { fprintf(stderr,"Unable to read index %s\n",queryPath);
       exit(1);
     }
-  strcpy(pgm,argv[1]) ;
-  if (strchr (pgm, '.') == NULL)
-     strcat(pgm,".tny");
-  source = fopen(pgm,"r");
+    return found > 0 ? 0 : 1;
+  }
+  if (stream && FlexScan)
+  { fprintf(stderr,"--stream uses the DFA scanner, not --flex\n");
+    exit(1);
+  }
+  if (stream && strcmp(argv[i],"-") == 0)
+  { strcpy(pgm,"stdin");
+    source = stdin;
+    /* the scanner thread needs the whole source mapped */
+    pipelined = FALSE;
+  }
+  else
+  { strcpy(pgm,argv[i]) ;
+    if (strchr (pgm, '.') == NULL)
+       strcat(pgm,".tny");
+    source = fopen(pgm,"r");
+  }
   if (source==NULL)
   { fprintf(stderr,"File %s not found\n",pgm);
     exit(1);
   }
+  /* the scanner thread would trace out of order */
+  if (TraceScan) pipelined = FALSE;
+  if ((!stream || pipelined) && !mapSource(source))
+  { fprintf(stderr,"Unable to map %s\n",pgm);
+    exit(1);
+  }
   listing = stdout; /* send listing to screen */
+  initNames();
+  currentArena = &compilation;
+#if !NO_PARSE && !NO_ANALYZE
+  /* the index also lists reads and calls */
+  if (xrefPath != NULL) st_recordUses(TRUE);
+#endif
 
   // print time of compilation
   time_t rawtime;
@@ -98,40 +463,117 @@ int main( int argc, char * argv[] )
   timeinfo = localtime ( &rawtime );
 
   fprintf(listing,"\nCMINUS COMPILATION: %s\nTIME OF COMPILATION: %s",pgm, asctime (timeinfo));
+  if (benchRounds > 0)
+  { scanBenchmark(benchRounds);
+    fclose(source);
+    return 0;
+  }
+  if (symtabSymbols > 0)
+  { symtabBenchmark(symtabSymbols);
+    if (jobs > 0) symtabThreadBenchmark(symtabSymbols, jobs);
+    arenaRelease(&compilation);
+    fclose(source);
+    return 0;
+  }
+  if (compileRounds > 0)
+  { compileBenchmark(compileRounds, jobs > 0 ? jobs : 1);
+    fclose(source);
+    return 0;
+  }
+  if (serveRounds > 0)
+  { serveBenchmark(connectPath, serveRounds);
+    fclose(source);
+    return 0;
+  }
+#if !NO_PARSE && !NO_ANALYZE && !NO_CODE
+  if (stream)
+  { compileStream(pgm, pipelined);
+    if (! parseOnly) saveXref(pgm);
+    printStats();
+    st_clear();
+    arenaRelease(&compilation);
+    if (source != stdin) fclose(source);
+    return 0;
+  }
+#endif
 #if NO_PARSE
   while (getToken()!=ENDFILE);
 #else
-  syntaxTree = parse();
+  if (tokenizeFirst)
+  { startPass();
+    tokens = tokenizeSource();
+    endPass("scan");
+    startPass();
+    syntaxTree = parseBuffer(tokens);
+    endPass("parse");
+  }
+  else if (jobs > 0)
+  { startPass();
+    syntaxTree = parallelParse(jobs);
+    endPass("scan+parse");
+  }
+  else
+  { startPass();
+    syntaxTree = parse();
+    endPass("scan+parse");
+  }
   if (TraceParse) {
     fprintf(listing,"\nSyntax tree:\n");
     printTree(syntaxTree);
   }
+  if (astRounds > 0 && ! Error)
+  { astBenchmark(syntaxTree, astRounds);
+    parseOnly = TRUE;
+  }
 #if !NO_ANALYZE
-  if (! Error)
+#if !NO_CODE
+  /* functions are analyzed and compiled on the threads that parsed them */
+  parallel = jobs > 0 && ! Error && ! parseOnly;
+#endif
+  if (! Error && ! parseOnly)
   { if (TraceAnalyze) fprintf(listing,"\nBuilding Symbol Table...\n");
-    buildSymtab(syntaxTree);
+    startPass();
+#if !NO_CODE
+    if (parallel)
+    { parallelAnalyze(syntaxTree, jobs);
+      endPass("symtab+codegen");
+    }
+    else
+#endif
+    { buildSymtab(syntaxTree);
+      endPass("symtab");
+    }
     if (TraceAnalyze) fprintf(listing,"\nChecking Types...\n");
+    startPass();
     typeCheck(syntaxTree);
+    endPass("typecheck");
     if (TraceAnalyze) fprintf(listing,"\nType Checking Finished\n");
+    saveXref(pgm);
   }
 #if !NO_CODE
-  if (! Error)
-  { char * codefile;
-    int fnlen = strcspn(pgm,".");
-    codefile = (char *) calloc(fnlen+4, sizeof(char));
-    strncpy(codefile,pgm,fnlen);
-    strcat(codefile,".tm");
+  if (! Error && ! parseOnly)
+  { char * codefile = codeFileName(pgm);
     code = fopen(codefile,"w");
     if (code == NULL)
     { printf("Unable to open %s\n",codefile);
       exit(1);
     }
-    codeGen(syntaxTree,codefile);
+    startPass();
+    if (parallel) parallelCodeGen(codefile);
+    else codeGen(syntaxTree,codefile);
     fclose(code);
+    endPass(parallel ? "write" : "codegen");
   }
+  else if (parallel) parallelCodeGen(NULL);
+#endif
 #endif
 #endif
+  printStats();
+#if !NO_PARSE && !NO_ANALYZE
+  st_clear();
 #endif
+  arenaRelease(&compilation);
+  freeTokenBuffer(tokens);
   fclose(source);
   return 0;
 }
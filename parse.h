@@ -14,4 +14,51 @@
  */
 TreeNode * parse(void);
 
+/* Function parseBuffer returns the syntax tree
+ * of a source file already scanned into tb
+ * (tokbuf.h must be included first)
+ */
+TreeNode * parseBuffer(TokenBuffer * tb);
+
+/* a DeclProc takes a top-level declaration */
+typedef void (* DeclProc) (TreeNode *);
+
+/* a TokenSource gives the parser its tokens
+ * in place of getToken
+ */
+typedef TokenType (* TokenSource) (void);
+
+/* Function parseStream parses the tokens of src,
+ * or of getToken if src is NULL, handing each
+ * top-level declaration over to proc as soon as it
+ * is parsed, before the rest of the file is read.
+ * No syntax tree is kept. Returns FALSE after a
+ * syntax error.
+ */
+int parseStream(TokenSource src, DeclProc proc);
+
+/* Function parseRange returns the syntax tree of
+ * the top-level declarations in bytes [start,end)
+ * of sourceText, which begin on source line line.
+ * Syntax errors are not reported: *ok is set to
+ * FALSE instead.
+ */
+TreeNode * parseRange(long start, long end, int line, int * ok);
+
+/* Function declEnd returns the offset just past
+ * the top-level declaration at offset pos of
+ * sourceText, or sourceLen if it ends first;
+ * *line is advanced by the lines passed and
+ * *blank tells whether they hold only blanks and
+ * comments. Returns -1 if a brace does not match.
+ */
+long declEnd(long pos, int * line, int * blank);
+
+/* Function parallelParse returns the syntax tree
+ * of the source file, parsing its top-level
+ * declarations on jobs threads. The tree and the
+ * listing are the same as those of parse().
+ */
+TreeNode * parallelParse(int jobs);
+
 #endif
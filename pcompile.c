@@ -0,0 +1,172 @@
+/****************************************************/
+/* File: pcompile.c                                 */
+/* Parallel analysis and code generation of the     */
+/* functions of a CMINUS program                    */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include "util.h"
+#include "arena.h"
+#include "symtab.h"
+#include "analyze.h"
+#include "cgen.h"
+#include "pcompile.h"
+
+/* a top-level declaration: its tree, analysis
+ * and code
+ */
+typedef struct
+   { TreeNode * t;
+     Analysis analysis;
+     CodeUnit code;
+   } Unit;
+
+static Unit * units;
+static int nunits = 0;
+
+/* the declarations left to a worker: the range
+ * [lo, hi) of units, packed as lo << 32 | hi so
+ * that the owner taking lo and a thief taking the
+ * upper half agree with a single compare-and-swap
+ */
+typedef struct
+   { _Alignas(64) _Atomic unsigned long long range;
+     Arena * arena; /* NULL: the arena of the caller */
+     pthread_t thread;
+     int id;
+   } Worker;
+
+static Worker * workers;
+static int nworkers;
+
+/* the globals of the thread that started the workers */
+static Globals parent;
+
+#define RANGE(lo, hi) ((unsigned long long) (lo) << 32 | (unsigned) (hi))
+#define LO(r) ((int) ((r) >> 32))
+#define HI(r) ((int) ((r) & 0xFFFFFFFFu))
+
+/* Function takeOwn returns the next unit of the
+ * range of w, or -1 if it is empty
+ */
+static int takeOwn(Worker * w)
+{ unsigned long long r = atomic_load_explicit(&w->range, memory_order_acquire);
+  while (LO(r) < HI(r))
+    if (atomic_compare_exchange_weak_explicit(&w->range, &r, RANGE(LO(r) + 1, HI(r)),
+                                              memory_order_acq_rel, memory_order_acquire))
+      return LO(r);
+  return -1;
+}
+
+/* Function steal moves the upper half of the
+ * range of another worker to the empty range of
+ * w; returns FALSE if every range is empty
+ */
+static int steal(Worker * w)
+{ int k;
+  for (k = 1; k < nworkers; k++)
+  { Worker * v = &workers[(w->id + k) % nworkers];
+    unsigned long long r = atomic_load_explicit(&v->range, memory_order_acquire);
+    while (LO(r) < HI(r))
+    { int mid = LO(r) + (HI(r) - LO(r)) / 2;
+      if (atomic_compare_exchange_weak_explicit(&v->range, &r, RANGE(LO(r), mid),
+                                                memory_order_acq_rel, memory_order_acquire))
+      { atomic_store_explicit(&w->range, RANGE(mid, HI(r)), memory_order_release);
+        return TRUE;
+      }
+    }
+  }
+  return FALSE;
+}
+
+/* Procedure work is run by every worker: it
+ * analyzes the bodies of its units and generates
+ * their code, in a symbol table of its own, then
+ * steals from the others until no unit is left
+ */
+static void * work(void * arg)
+{ Worker * w = (Worker *) arg;
+  if (w->arena != NULL)
+  { loadGlobals(&parent);
+    currentArena = w->arena;
+  }
+  st_beginThread();
+  do
+  { int i;
+    while ((i = takeOwn(w)) >= 0)
+    { analyzeBody(units[i].analysis);
+      codeGenUnit(units[i].t, &units[i].code);
+    }
+  } while (steal(w));
+  codeGenRelease();
+  st_endThread();
+  return NULL;
+}
+
+/* Procedure parallelAnalyze leaves the symbol
+ * table, the checks and the listing of
+ * buildSymtab(tree), analyzing the bodies of the
+ * functions on jobs threads. Their code is
+ * generated at the same time and kept for
+ * parallelCodeGen.
+ */
+void parallelAnalyze(TreeNode * tree, int jobs)
+{ TreeNode * t;
+  int i;
+  startAnalysis();
+  nunits = 0;
+  for (t = tree; t != NULL; t = t->sibling) nunits++;
+  units = (Unit *) calloc(nunits + 1, sizeof(Unit));
+  workers = (Worker *) calloc(jobs, sizeof(Worker));
+  if (units == NULL || workers == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  /* the globals, and the function names, in order */
+  for (t = tree, i = 0; t != NULL; t = t->sibling, i++)
+  { units[i].t = t;
+    units[i].analysis = analyzeHead(t, i);
+  }
+  st_publish();
+  saveGlobals(&parent);
+  nworkers = jobs;
+  for (i = 0; i < jobs; i++)
+  { workers[i].id = i;
+    workers[i].range = RANGE((long) nunits * i / jobs, (long) nunits * (i + 1) / jobs);
+    if (i > 0) workers[i].arena = (Arena *) calloc(1, sizeof(Arena));
+  }
+  for (i = 1; i < jobs; i++)
+    pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+  work(&workers[0]);
+  for (i = 1; i < jobs; i++)
+  { pthread_join(workers[i].thread, NULL);
+    /* the symbols of the workers now belong to the compilation */
+    arenaJoin(currentArena, workers[i].arena);
+    free(workers[i].arena);
+  }
+  free(workers);
+  st_unpublish();
+  for (i = 0; i < nunits; i++)
+    analyzeMerge(units[i].analysis);
+  if (TraceAnalyze) listSymtab();
+}
+
+/* Procedure parallelCodeGen writes the code kept
+ * by parallelAnalyze to the code file, as codeGen
+ * would, or only frees it if codefile is NULL
+ */
+void parallelCodeGen(char * codefile)
+{ int i;
+  if (codefile != NULL) codeGenStart(codefile);
+  for (i = 0; i < nunits; i++)
+    if (codefile != NULL) codeGenPlace(&units[i].code);
+    else free(units[i].code.text);
+  if (codefile != NULL) codeGenEnd();
+  free(units);
+  units = NULL;
+  nunits = 0;
+}
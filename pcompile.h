@@ -0,0 +1,27 @@
+/****************************************************/
+/* File: pcompile.h                                 */
+/* Parallel analysis and code generation of the     */
+/* functions of a CMINUS program                    */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _PCOMPILE_H_
+#define _PCOMPILE_H_
+
+/* Procedure parallelAnalyze leaves the symbol
+ * table, the checks and the listing of
+ * buildSymtab(tree), analyzing the bodies of the
+ * functions on jobs threads that share them out by
+ * work stealing. Their code is generated at the
+ * same time and kept for parallelCodeGen.
+ */
+void parallelAnalyze(TreeNode * tree, int jobs);
+
+/* Procedure parallelCodeGen writes the code kept
+ * by parallelAnalyze to the code file, as codeGen
+ * would, or only frees it if codefile is NULL
+ */
+void parallelCodeGen(char * codefile);
+
+#endif
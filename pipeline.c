@@ -0,0 +1,307 @@
+/****************************************************/
+/* File: pipeline.c                                 */
+/* Pipelined compilation for the CMINUS compiler    */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "util.h"
+#include "arena.h"
+#include "scan.h"
+#include "tokbuf.h"
+#include "parse.h"
+#include "cgen.h"
+#include "pipeline.h"
+
+/* TOKENRING and DECLRING are the number of slots
+ * of the token queue and of the declaration queue
+ */
+#define TOKENRING 65536
+#define DECLRING 256
+
+/* SPINS is the number of times a stage polls an
+ * empty or full queue before yielding the CPU
+ */
+#define SPINS 64
+
+/* a single-producer single-consumer ring of
+ * fixed-size slots. head is only written by the
+ * consumer and tail only by the producer, each on
+ * a cache line of its own; each side caches the
+ * other's index and reloads it only when the ring
+ * looks empty or full.
+ */
+typedef struct
+   { char * slots;
+     int size;   /* number of slots, a power of two */
+     int width;  /* bytes per slot */
+     _Alignas(64) atomic_long head;  /* next slot to pop */
+     long tailSeen;                  /* consumer's copy of tail */
+     _Alignas(64) atomic_long tail;  /* next slot to push */
+     long headSeen;                  /* producer's copy of head */
+     _Alignas(64) atomic_int closed; /* TRUE: the other side is gone */
+   } Ring;
+
+/* the time each stage spends, and the part of it
+ * spent waiting on a queue
+ */
+typedef struct
+   { struct timespec start;
+     double wall;
+     double wait;
+     long items;
+   } StageTime;
+
+/* a token as the scanner thread saw it */
+typedef struct
+   { TokenType kind;
+     int len;
+     long pos;
+     int line;
+     char * name; /* interned name of an ID, or NULL */
+   } TokenSlot;
+
+/* a parsed top-level declaration and the arena
+ * its tree was allocated from
+ */
+typedef struct
+   { TreeNode * tree;
+     Arena arena;
+   } DeclSlot;
+
+static Ring tokenRing;
+static Ring declRing;
+static StageTime scanTime, parseTime, backTime;
+static DeclProc backProc;
+static Arena * backArena;
+
+/* the arena of the declaration being parsed */
+static Arena parseArena;
+
+/* the globals of the parser thread, which the
+ * other stages take over, and the errors the back
+ * end reports
+ */
+static Globals parent;
+static int backErrors;
+
+static double seconds(struct timespec * t)
+{ return t->tv_sec + t->tv_nsec / 1e9;
+}
+
+static void stageStart(StageTime * st)
+{ memset(st, 0, sizeof(StageTime));
+  clock_gettime(CLOCK_MONOTONIC, &st->start);
+}
+
+static void stageEnd(StageTime * st)
+{ struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  st->wall = seconds(&now) - seconds(&st->start);
+}
+
+static void initRing(Ring * r, int size, int width)
+{ r->slots = (char *) malloc((size_t) size * width);
+  if (r->slots == NULL)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    exit(1);
+  }
+  r->size = size;
+  r->width = width;
+  atomic_store(&r->head, 0);
+  atomic_store(&r->tail, 0);
+  atomic_store(&r->closed, FALSE);
+  r->tailSeen = 0;
+  r->headSeen = 0;
+}
+
+/* Procedure waitFor spins, then yields, until
+ * ready returns TRUE or the ring is closed;
+ * the time is charged to st as waiting
+ */
+static int waitFor(Ring * r, int (* ready)(Ring *), StageTime * st)
+{ struct timespec t0, t1;
+  int i;
+  for (i = 0; i < SPINS; i++)
+    if (ready(r)) return TRUE;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  while (!ready(r) && !atomic_load_explicit(&r->closed, memory_order_acquire))
+    sched_yield();
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  st->wait += seconds(&t1) - seconds(&t0);
+  return ready(r);
+}
+
+static int hasRoom(Ring * r)
+{ long tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  if (tail - r->headSeen < r->size) return TRUE;
+  r->headSeen = atomic_load_explicit(&r->head, memory_order_acquire);
+  return tail - r->headSeen < r->size;
+}
+
+static int hasItem(Ring * r)
+{ long head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  if (head < r->tailSeen) return TRUE;
+  r->tailSeen = atomic_load_explicit(&r->tail, memory_order_acquire);
+  return head < r->tailSeen;
+}
+
+/* Function push copies item into the ring,
+ * waiting for room; returns FALSE if the consumer
+ * has closed the ring
+ */
+static int push(Ring * r, const void * item, StageTime * st)
+{ long tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  if (!hasRoom(r) && !waitFor(r, hasRoom, st)) return FALSE;
+  memcpy(r->slots + (tail & (r->size - 1)) * r->width, item, r->width);
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+  return TRUE;
+}
+
+/* Function pop copies the next item of the ring,
+ * waiting for one; returns FALSE if the producer
+ * has closed the ring and it is empty
+ */
+static int pop(Ring * r, void * item, StageTime * st)
+{ long head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  if (!hasItem(r) && !waitFor(r, hasItem, st)) return FALSE;
+  memcpy(item, r->slots + (head & (r->size - 1)) * r->width, r->width);
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+  return TRUE;
+}
+
+/* Procedure scanStage is the scanner thread: it
+ * pushes every token of the source into the token
+ * ring, interning identifiers on the way
+ */
+static void * scanStage(void * arg)
+{ TokenSlot t;
+  (void) arg;
+  loadGlobals(&parent);
+  stageStart(&scanTime);
+  resetScanner();
+  lineno = 0;
+  do
+  { t.kind = getToken();
+    t.pos = tokenPos;
+    t.len = tokenLen;
+    t.line = lineno;
+    t.name = t.kind == ID ? identifierName() : NULL;
+    if (!push(&tokenRing, &t, &scanTime)) break;
+    scanTime.items++;
+  } while (t.kind != ENDFILE);
+  atomic_store_explicit(&tokenRing.closed, TRUE, memory_order_release);
+  stageEnd(&scanTime);
+  return NULL;
+}
+
+/* Function nextToken gives the parser the next
+ * token of the token ring, restoring the scanner
+ * state as getToken would have left it
+ */
+static TokenType nextToken(void)
+{ TokenSlot t;
+  if (!pop(&tokenRing, &t, &parseTime)) return ENDFILE;
+  parseTime.items++;
+  tokenPos = t.pos;
+  tokenLen = t.len;
+  if (t.kind == ID)
+  { idPos = t.pos;
+    idLen = t.len;
+    idName = t.name;
+  }
+  lineno = t.line;
+  return t.kind;
+}
+
+/* Procedure sendDecl passes a parsed declaration,
+ * with its arena, on to the back end; the parser
+ * goes on in a fresh arena
+ */
+static void sendDecl(TreeNode * t)
+{ DeclSlot d;
+  d.tree = t;
+  d.arena = parseArena;
+  memset(&parseArena, 0, sizeof(Arena));
+  if (!push(&declRing, &d, &parseTime)) arenaRelease(&d.arena);
+}
+
+/* Procedure backStage is the back end thread: it
+ * analyzes and generates code for each declaration,
+ * then releases its tree
+ */
+static void * backStage(void * arg)
+{ DeclSlot d;
+  (void) arg;
+  loadGlobals(&parent);
+  stageStart(&backTime);
+  currentArena = backArena;
+  while (pop(&declRing, &d, &backTime))
+  { backProc(d.tree);
+    backArena->nodes += d.arena.nodes;
+    arenaRelease(&d.arena);
+    backTime.items++;
+  }
+  codeGenRelease();
+  backErrors = Error - parent.error;
+  stageEnd(&backTime);
+  return NULL;
+}
+
+static void reportStage(char * name, StageTime * st, char * unit)
+{ fprintf(stderr,"%-12s %10.3f ms %5.1f%% busy %10ld %s\n",name,st->wall * 1e3,
+          st->wall > 0 ? 100.0 * (st->wall - st->wait) / st->wall : 0.0,
+          st->items,unit);
+}
+
+/* Function pipelineParse parses the mapped source
+ * file with the scanner on a thread of its own and
+ * hands each top-level declaration over to proc on
+ * a third thread, which allocates from arena back.
+ * Both threads start with the globals of the
+ * caller, and the errors of proc are added to
+ * its Error.
+ * The tree of a declaration is released after proc
+ * has returned, and its nodes are counted in back.
+ * If report is TRUE, the utilisation of each stage
+ * is printed to stderr. Returns FALSE after a
+ * syntax error.
+ */
+int pipelineParse(DeclProc proc, Arena * back, int report)
+{ pthread_t scanner, backEnd;
+  Arena * savedArena = currentArena;
+  int ok;
+  initRing(&tokenRing, TOKENRING, sizeof(TokenSlot));
+  initRing(&declRing, DECLRING, sizeof(DeclSlot));
+  backProc = proc;
+  backArena = back;
+  saveGlobals(&parent);
+  pthread_create(&scanner, NULL, scanStage, NULL);
+  pthread_create(&backEnd, NULL, backStage, NULL);
+  stageStart(&parseTime);
+  currentArena = &parseArena;
+  ok = parseStream(nextToken, sendDecl);
+  /* stop the scanner if the parse ended early */
+  atomic_store_explicit(&tokenRing.closed, TRUE, memory_order_release);
+  atomic_store_explicit(&declRing.closed, TRUE, memory_order_release);
+  stageEnd(&parseTime);
+  pthread_join(scanner, NULL);
+  pthread_join(backEnd, NULL);
+  Error += backErrors;
+  back->nodes += parseArena.nodes;
+  arenaRelease(&parseArena);
+  currentArena = savedArena;
+  free(tokenRing.slots);
+  free(declRing.slots);
+  if (report)
+  { reportStage("scan", &scanTime, "tokens");
+    reportStage("parse", &parseTime, "tokens");
+    reportStage("analyze+gen", &backTime, "decls");
+  }
+  return ok;
+}
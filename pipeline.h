@@ -0,0 +1,27 @@
+/****************************************************/
+/* File: pipeline.h                                 */
+/* Pipelined compilation for the CMINUS compiler:   */
+/* the scanner, the parser and the back end run on  */
+/* threads of their own, joined by lock-free queues */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+/* parse.h and arena.h must be included first */
+
+/* Function pipelineParse parses the mapped source
+ * file with the scanner on a thread of its own and
+ * hands each top-level declaration over to proc on
+ * a third thread, which allocates from arena back.
+ * The tree of a declaration is released after proc
+ * has returned, and its nodes are counted in back.
+ * If report is TRUE, the utilisation of each stage
+ * is printed to stderr. Returns FALSE after a
+ * syntax error.
+ */
+int pipelineParse(DeclProc proc, Arena * back, int report);
+
+#endif
@@ -0,0 +1,200 @@
+/****************************************************/
+/* File: pparse.c                                   */
+/* Parallel parsing of top-level declarations       */
+/* for the CMINUS compiler                          */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include "util.h"
+#include "arena.h"
+#include "scan.h"
+#include "tokbuf.h"
+#include "parse.h"
+
+/* CHUNKS_PER_JOB is the number of chunks each
+ * thread gets on average, so that threads that
+ * finish early can take over remaining work
+ */
+#define CHUNKS_PER_JOB 4
+
+/* a run of consecutive top-level declarations */
+typedef struct
+   { long start;     /* offset of the first byte */
+     long end;       /* offset just past the last byte */
+     int line;       /* source line of the first byte */
+     TreeNode * tree; /* sibling chain of its declarations */
+     int ok;         /* FALSE if it had a syntax error */
+   } Chunk;
+
+static Chunk * chunks;
+static int nchunks;
+static atomic_int nextChunk;
+
+/* lineno as the serial parser leaves it */
+static int lastLine;
+
+/* the globals of the thread that started the parse */
+static Globals parent;
+
+/* Function declEnd returns the offset just past
+ * the top-level declaration at offset pos of the
+ * source: past the ';' or the '}' closing the
+ * outermost brace that ends it, or the end of the
+ * source. Comments are skipped the same way the
+ * scanner skips them. *line is advanced by the
+ * lines passed, and *blank tells whether they hold
+ * only blanks and comments. Returns -1 if the
+ * braces of the source do not match.
+ */
+long declEnd(long pos, int * line, int * blank)
+{ const char * s = sourceText;
+  long len = sourceLen;
+  int depth = 0;
+  *blank = TRUE;
+  while (pos < len)
+  { char c = s[pos++];
+    if (c == '\n') (*line)++;
+    else if (c == '/' && pos < len && s[pos] == '*')
+    { pos++;
+      for (;;)
+      { while (pos < len && s[pos] != '*')
+        { if (s[pos] == '\n') (*line)++;
+          pos++;
+        }
+        if (pos >= len) break;
+        pos++;
+        if (pos < len && s[pos] == '/')
+        { pos++;
+          break;
+        }
+      }
+      c = ' '; /* a comment is a blank */
+    }
+    else if (c == '{') depth++;
+    else if (c == '}' && --depth < 0) return -1;
+    if (!isspace((unsigned char) c)) *blank = FALSE;
+    if (depth == 0 && (c == ';' || c == '}')) return pos;
+  }
+  return depth == 0 ? len : -1;
+}
+
+/* Function splitDecls divides the source into at
+ * most maxChunks chunks that end where a top-level
+ * declaration ends. Returns the number of chunks,
+ * or 0 if the braces of the source do not match.
+ */
+static int splitDecls(int maxChunks)
+{ long target = sourceLen / maxChunks + 1;
+  long pos = 0, start = 0;
+  int line = 1, startLine = 1;
+  int n = 0;
+  int pending = FALSE; /* TRUE if a token follows start */
+  chunks = (Chunk *) malloc((maxChunks + 1) * sizeof(Chunk));
+  if (chunks == NULL) return 0;
+  while (pos < sourceLen)
+  { int blank;
+    pos = declEnd(pos, &line, &blank);
+    if (pos < 0) return 0;
+    if (!blank) pending = TRUE;
+    if (pending && pos - start >= target && n < maxChunks - 1)
+    { chunks[n].start = start;
+      chunks[n].end = pos;
+      chunks[n].line = startLine;
+      n++;
+      start = pos;
+      startLine = line;
+      pending = FALSE;
+    }
+  }
+  lastLine = line;
+  if (n > 0 && !pending)
+  { /* only blanks and comments are left */
+    chunks[n - 1].end = sourceLen;
+    return n;
+  }
+  chunks[n].start = start;
+  chunks[n].end = sourceLen;
+  chunks[n].line = startLine;
+  return n + 1;
+}
+
+/* Procedure parseChunks is run by every thread:
+ * it parses chunks until none is left. Worker
+ * threads allocate from their own arena arg.
+ */
+static void * parseChunks(void * arg)
+{ int i;
+  if (arg != NULL)
+  { loadGlobals(&parent);
+    currentArena = (Arena *) arg;
+  }
+  while ((i = atomic_fetch_add(&nextChunk, 1)) < nchunks)
+    chunks[i].tree = parseRange(chunks[i].start, chunks[i].end,
+                                chunks[i].line, &chunks[i].ok);
+  return NULL;
+}
+
+/* Function serialParse parses the whole source
+ * file with a fresh scanner on the calling thread
+ */
+static TreeNode * serialParse(void)
+{ resetScanner();
+  lineno = 0;
+  return parse();
+}
+
+/* Function parallelParse returns the syntax tree
+ * of the source file, parsing its top-level
+ * declarations on jobs threads. The tree and the
+ * listing are the same as those of parse(): if a
+ * chunk has a syntax error the whole file is parsed
+ * again serially so that the error is reported as
+ * usual.
+ */
+TreeNode * parallelParse(int jobs)
+{ pthread_t * threads;
+  Arena * arenas;
+  TreeNode * tree = NULL;
+  TreeNode * last = NULL;
+  int i, ok = TRUE;
+  if (jobs < 1 || TraceScan || FlexScan) return parse();
+  nchunks = splitDecls(jobs * CHUNKS_PER_JOB);
+  if (nchunks == 0)
+  { free(chunks);
+    return serialParse();
+  }
+  atomic_store(&nextChunk, 0);
+  saveGlobals(&parent);
+  threads = (pthread_t *) malloc(jobs * sizeof(pthread_t));
+  arenas = (Arena *) calloc(jobs, sizeof(Arena));
+  for (i = 1; i < jobs; i++)
+    pthread_create(&threads[i], NULL, parseChunks, &arenas[i]);
+  parseChunks(NULL);
+  for (i = 1; i < jobs; i++)
+  { pthread_join(threads[i], NULL);
+    /* the trees of the workers now belong to the compilation */
+    arenaJoin(currentArena, &arenas[i]);
+  }
+  free(arenas);
+  free(threads);
+  /* stitch the sibling chains together in source order */
+  for (i = 0; i < nchunks && ok; i++)
+  { if (!chunks[i].ok || chunks[i].tree == NULL)
+    { ok = FALSE;
+      break;
+    }
+    if (last == NULL) tree = chunks[i].tree;
+    else last->sibling = chunks[i].tree;
+    last = chunks[i].tree;
+    while (last->sibling != NULL) last = last->sibling;
+  }
+  free(chunks);
+  chunks = NULL;
+  if (!ok) return serialParse();
+  lineno = lastLine;
+  return tree;
+}
@@ -0,0 +1,479 @@
+/****************************************************/
+/* File: scan.c                                     */
+/* Hand-written DFA scanner for the CMINUS compiler */
+/* Blank, comment and identifier runs are skipped   */
+/* with SSE2/AVX2 byte-class scans                  */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "util.h"
+#include "scan.h"
+#include "intern.h"
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* lexeme of the current token, for listings */
+THREAD_LOCAL char tokenString[MAXTOKENLEN+1];
+
+/* spans of the current token and of the most
+ * recent identifier in sourceText
+ */
+THREAD_LOCAL long tokenPos = 0;
+THREAD_LOCAL int tokenLen = 0;
+THREAD_LOCAL long idPos = 0;
+THREAD_LOCAL int idLen = 0;
+THREAD_LOCAL char * idName = NULL;
+
+/* interface to the flex-generated scanner in cminus.l */
+extern FILE * yyin;
+extern FILE * yyout;
+int yylex(void);
+void yyrestart(FILE *);
+
+/* STREAMBUF is the initial size of the buffer
+ * a streamed source file is read into
+ */
+#define STREAMBUF 65536
+
+/* the source text as seen by the DFA scanner */
+typedef struct
+   { const char * text; /* source file mapped by main */
+     long len;          /* number of bytes in text */
+     long pos;          /* offset of the next unscanned byte */
+     FILE * stream;     /* source read in pieces, or NULL */
+     char * buf;        /* buffer of the stream */
+     long size;         /* allocated bytes of buf */
+     int eof;           /* TRUE once the stream is exhausted */
+   } ScanBuffer;
+
+static THREAD_LOCAL ScanBuffer sb;
+
+/* firstTime = TRUE until the first token of the
+ * current source file has been requested
+ */
+static THREAD_LOCAL int firstTime = TRUE;
+
+/* Function skipBlanks returns the offset of the first
+ * byte at or after pos that is not a blank, tab or
+ * newline. Newlines passed over are added to lineno.
+ */
+static long skipBlanks(const char * s, long pos, long len)
+{
+#if defined(__AVX2__)
+  const __m256i sp = _mm256_set1_epi8(' ');
+  const __m256i tb = _mm256_set1_epi8('\t');
+  const __m256i nl = _mm256_set1_epi8('\n');
+  while (pos + 32 <= len)
+  { __m256i v = _mm256_loadu_si256((const __m256i *) (s + pos));
+    __m256i n = _mm256_cmpeq_epi8(v, nl);
+    __m256i b = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+                                                _mm256_cmpeq_epi8(v, tb)), n);
+    unsigned nmask = (unsigned) _mm256_movemask_epi8(n);
+    unsigned bmask = (unsigned) _mm256_movemask_epi8(b);
+    if (bmask != 0xFFFFFFFFu)
+    { int k = __builtin_ctz(~bmask);
+      lineno += __builtin_popcount(nmask & ((1u << k) - 1));
+      return pos + k;
+    }
+    lineno += __builtin_popcount(nmask);
+    pos += 32;
+  }
+#elif defined(__SSE2__)
+  const __m128i sp = _mm_set1_epi8(' ');
+  const __m128i tb = _mm_set1_epi8('\t');
+  const __m128i nl = _mm_set1_epi8('\n');
+  while (pos + 16 <= len)
+  { __m128i v = _mm_loadu_si128((const __m128i *) (s + pos));
+    __m128i n = _mm_cmpeq_epi8(v, nl);
+    __m128i b = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp),
+                                          _mm_cmpeq_epi8(v, tb)), n);
+    unsigned nmask = (unsigned) _mm_movemask_epi8(n);
+    unsigned bmask = (unsigned) _mm_movemask_epi8(b);
+    if (bmask != 0xFFFFu)
+    { int k = __builtin_ctz(~bmask);
+      lineno += __builtin_popcount(nmask & ((1u << k) - 1));
+      return pos + k;
+    }
+    lineno += __builtin_popcount(nmask);
+    pos += 16;
+  }
+#endif
+  while (pos < len && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n'))
+  { if (s[pos] == '\n') lineno++;
+    pos++;
+  }
+  return pos;
+}
+
+/* Function skipLetters returns the offset of the
+ * first byte at or after pos that is not a letter
+ */
+static long skipLetters(const char * s, long pos, long len)
+{
+#if defined(__AVX2__)
+  /* (c|0x20) - 'a' biased into signed range: letters map below -102 */
+  const __m256i lower = _mm256_set1_epi8(0x20);
+  const __m256i bias = _mm256_set1_epi8((char) (0x80 - 'a'));
+  const __m256i limit = _mm256_set1_epi8((char) (-128 + 26));
+  while (pos + 32 <= len)
+  { __m256i v = _mm256_loadu_si256((const __m256i *) (s + pos));
+    __m256i t = _mm256_add_epi8(_mm256_or_si256(v, lower), bias);
+    unsigned m = (unsigned) _mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, t));
+    if (m != 0xFFFFFFFFu) return pos + __builtin_ctz(~m);
+    pos += 32;
+  }
+#elif defined(__SSE2__)
+  const __m128i lower = _mm_set1_epi8(0x20);
+  const __m128i bias = _mm_set1_epi8((char) (0x80 - 'a'));
+  const __m128i limit = _mm_set1_epi8((char) (-128 + 26));
+  while (pos + 16 <= len)
+  { __m128i v = _mm_loadu_si128((const __m128i *) (s + pos));
+    __m128i t = _mm_add_epi8(_mm_or_si128(v, lower), bias);
+    unsigned m = (unsigned) _mm_movemask_epi8(_mm_cmplt_epi8(t, limit));
+    if (m != 0xFFFFu) return pos + __builtin_ctz(~m);
+    pos += 16;
+  }
+#endif
+  while (pos < len && isalpha((unsigned char) s[pos]))
+    pos++;
+  return pos;
+}
+
+/* Function skipComment returns the offset just past
+ * the "* /" closing the comment whose body starts at
+ * pos, or len if the comment is not closed. Newlines
+ * inside the comment are added to lineno.
+ */
+static long skipComment(const char * s, long pos, long len)
+{ for (;;)
+  {
+#if defined(__AVX2__)
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    while (pos + 32 <= len)
+    { __m256i v = _mm256_loadu_si256((const __m256i *) (s + pos));
+      unsigned smask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, star));
+      unsigned nmask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+      if (smask != 0)
+      { int k = __builtin_ctz(smask);
+        lineno += __builtin_popcount(nmask & ((1u << k) - 1));
+        pos += k;
+        break;
+      }
+      lineno += __builtin_popcount(nmask);
+      pos += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (pos + 16 <= len)
+    { __m128i v = _mm_loadu_si128((const __m128i *) (s + pos));
+      unsigned smask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, star));
+      unsigned nmask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+      if (smask != 0)
+      { int k = __builtin_ctz(smask);
+        lineno += __builtin_popcount(nmask & ((1u << k) - 1));
+        pos += k;
+        break;
+      }
+      lineno += __builtin_popcount(nmask);
+      pos += 16;
+    }
+#endif
+    while (pos < len && s[pos] != '*')
+    { if (s[pos] == '\n') lineno++;
+      pos++;
+    }
+    if (pos >= len) return len;
+    /* s[pos] is a star */
+    pos++;
+    if (pos < len && s[pos] == '/') return pos + 1;
+  }
+}
+
+/* Reserved words are recognized with a perfect hash
+ * on the first two letters and the length of the word
+ */
+#define KEYHASH(s,n) ((((unsigned char) (s)[0] << 1) + \
+                       ((unsigned char) (s)[1] << 3) + (n)) & 7)
+
+static const struct
+    { char * str;
+      TokenType tok;
+    } reservedWords[8] =
+    { /* slot = KEYHASH of the word */
+      { "void", VOID }, { NULL, 0 }, { "return", RETURN }, { "while", WHILE },
+      { "if", IF }, { "int", INT }, { "else", ELSE }, { NULL, 0 }
+    };
+
+/* Function reservedLookup returns the reserved word
+ * token for the n letters at s, or ID if none
+ */
+static TokenType reservedLookup(const char * s, int n)
+{ int h;
+  if (n < 2 || n > 6) return ID;
+  h = KEYHASH(s, n);
+  if (reservedWords[h].str != NULL &&
+      strncmp(reservedWords[h].str, s, n) == 0 &&
+      reservedWords[h].str[n] == '\0')
+    return reservedWords[h].tok;
+  return ID;
+}
+
+/* Function refill reads more of the stream into
+ * the scan buffer, first dropping the bytes no
+ * longer needed: those before the next unscanned
+ * byte, the current token and an identifier not
+ * yet interned. Offsets into the buffer are moved
+ * accordingly. Returns FALSE at the end of the
+ * stream.
+ */
+static int refill(void)
+{ long keep = sb.pos;
+  long n;
+  if (sb.stream == NULL || sb.eof) return FALSE;
+  if (tokenPos < keep) keep = tokenPos;
+  if (idName == NULL && idLen > 0 && idPos < keep) keep = idPos;
+  if (keep > 0)
+  { memmove(sb.buf, sb.buf + keep, sb.len - keep);
+    sb.len -= keep;
+    sb.pos -= keep;
+    tokenPos -= keep;
+    idPos = idPos >= keep ? idPos - keep : 0;
+  }
+  if (sb.len == sb.size)
+  { char * buf = realloc(sb.buf, sb.size * 2);
+    if (buf == NULL)
+    { fprintf(listing,"Out of memory error at line %d\n",lineno);
+      exit(1);
+    }
+    sb.buf = buf;
+    sb.size *= 2;
+  }
+  do n = read(fileno(sb.stream), sb.buf + sb.len, sb.size - sb.len);
+  while (n < 0 && errno == EINTR);
+  if (n <= 0)
+  { sb.eof = TRUE;
+    return FALSE;
+  }
+  sb.len += n;
+  sb.text = sourceText = sb.buf;
+  sourceLen = sb.len;
+  return TRUE;
+}
+
+/* Function dfaToken returns the next token in the
+ * scan buffer. It accepts the same language as the
+ * flex specification in cminus.l. When a stream is
+ * scanned, a token that reaches the end of the
+ * buffer may go on in the unread input, so the
+ * buffer is refilled and the token scanned again.
+ */
+static TokenType dfaToken(void)
+{ const char * s;
+  long len;
+  long pos;
+  long start;
+  int line = lineno;
+  TokenType tok;
+retry:
+  s = sb.text;
+  len = sb.len;
+  pos = sb.pos;
+  for (;;)
+  { pos = skipBlanks(s, pos, len);
+    if (pos >= len)
+    { if (refill())
+      { lineno = line;
+        goto retry;
+      }
+      sb.pos = tokenPos = pos;
+      tokenLen = 0;
+      return ENDFILE;
+    }
+    if (s[pos] == '/' && pos + 1 < len && s[pos+1] == '*')
+    { pos = skipComment(s, pos + 2, len);
+      continue;
+    }
+    break;
+  }
+  start = pos;
+  switch (s[pos])
+  { case '=':
+      if (pos + 1 < len && s[pos+1] == '=') { tok = EQEQ; pos += 2; }
+      else { tok = EQ; pos++; }
+      break;
+    case '<':
+      if (pos + 1 < len && s[pos+1] == '=') { tok = LEQ; pos += 2; }
+      else { tok = LT; pos++; }
+      break;
+    case '>':
+      if (pos + 1 < len && s[pos+1] == '=') { tok = GEQ; pos += 2; }
+      else { tok = GT; pos++; }
+      break;
+    case '!':
+      if (pos + 1 < len && s[pos+1] == '=') { tok = INEQ; pos += 2; }
+      else { tok = ERROR; pos++; }
+      break;
+    case '+': tok = PLUS; pos++; break;
+    case ',': tok = COMMA; pos++; break;
+    case '-': tok = MINUS; pos++; break;
+    case '*': tok = TIMES; pos++; break;
+    case '/': tok = OVER; pos++; break;
+    case '(': tok = LPAREN; pos++; break;
+    case ')': tok = RPAREN; pos++; break;
+    case '[': tok = LBRACKETS; pos++; break;
+    case ']': tok = RBRACKETS; pos++; break;
+    case '{': tok = LCBRACES; pos++; break;
+    case '}': tok = RCBRACES; pos++; break;
+    case ';': tok = SEMI; pos++; break;
+    default:
+      if (isdigit((unsigned char) s[pos]))
+      { while (pos < len && isdigit((unsigned char) s[pos])) pos++;
+        tok = NUM;
+      }
+      else if (isalpha((unsigned char) s[pos]))
+      { pos = skipLetters(s, pos, len);
+        tok = reservedLookup(s + start, (int) (pos - start));
+        if (tok == ID)
+        { idPos = start;
+          idLen = (int) (pos - start);
+          idName = NULL;
+        }
+      }
+      else
+      { tok = ERROR;
+        pos++;
+      }
+      break;
+  }
+  if (pos >= len && refill())
+  { lineno = line;
+    goto retry;
+  }
+  tokenPos = start;
+  tokenLen = (int) (pos - start);
+  sb.pos = pos;
+  return tok;
+}
+
+/* Procedure resetScanner makes the next call to
+ * getToken start scanning again at the beginning
+ * of the source file
+ */
+void resetScanner(void)
+{ firstTime = TRUE;
+  sb.pos = 0;
+  tokenPos = tokenLen = 0;
+  idPos = idLen = 0;
+  idName = NULL;
+}
+
+/* Function getToken returns the
+ * next token in source file
+ */
+TokenType getToken(void)
+{ TokenType currentToken;
+  if (firstTime)
+  { firstTime = FALSE;
+    lineno++;
+    if (FlexScan)
+    { yyrestart(source);
+      yyout = listing;
+    }
+    else
+    { sb.text = sourceText;
+      sb.len = sourceLen;
+    }
+  }
+  currentToken = FlexScan ? yylex() : dfaToken();
+  if (TraceScan) {
+    fprintf(listing,"\t%d: ",lineno);
+    printToken(currentToken,tokenText());
+  }
+  return currentToken;
+}
+
+/* Procedure scanStream makes getToken scan the
+ * file f, read in pieces as the scanner needs it,
+ * instead of the mapped source file. Only the
+ * bytes of the current tokens are kept.
+ */
+void scanStream(FILE * f)
+{ resetScanner();
+  sb.stream = f;
+  sb.eof = FALSE;
+  sb.size = STREAMBUF;
+  sb.buf = (char *) malloc(sb.size);
+  if (sb.buf == NULL)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    exit(1);
+  }
+  sb.len = 0;
+  sourceText = sb.buf;
+  sourceLen = 0;
+}
+
+/* Procedure scanRange makes getToken scan only
+ * the bytes [start,end) of sourceText, which
+ * begin on source line line
+ */
+void scanRange(long start, long end, int line)
+{ firstTime = FALSE;
+  sb.text = sourceText;
+  sb.len = end;
+  sb.pos = start;
+  tokenPos = start;
+  tokenLen = 0;
+  idPos = idLen = 0;
+  idName = NULL;
+  lineno = line;
+}
+
+/* Function tokenText copies at most MAXTOKENLEN
+ * characters of the current lexeme into
+ * tokenString and returns it
+ */
+char * tokenText(void)
+{ int n = tokenLen > MAXTOKENLEN ? MAXTOKENLEN : tokenLen;
+  memcpy(tokenString, sourceText + tokenPos, n);
+  tokenString[n] = '\0';
+  return tokenString;
+}
+
+/* Function tokenValue returns the value
+ * of the current NUM token, or INT_MAX if
+ * it does not fit in an int
+ */
+int tokenValue(void)
+{ int val = 0;
+  int i;
+  for (i = 0; i < tokenLen; i++)
+  { int digit = sourceText[tokenPos + i] - '0';
+    if (val > (INT_MAX - digit) / 10) return INT_MAX;
+    val = val * 10 + digit;
+  }
+  return val;
+}
+
+/* Function identifierName returns the interned
+ * name of the most recently scanned identifier
+ */
+char * identifierName(void)
+{ if (idName == NULL) idName = internName(sourceText + idPos, idLen);
+  return idName;
+}
+
+/* Function tokenName returns the interned
+ * lexeme of the current token
+ */
+char * tokenName(void)
+{ return internName(sourceText + tokenPos, tokenLen);
+}
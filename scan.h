@@ -8,16 +8,71 @@
 #ifndef _SCAN_H_
 #define _SCAN_H_
 
-/* MAXTOKENLEN is the maximum size of a token */
+/* MAXTOKENLEN is the maximum size of a token
+ * as echoed to the listing file
+ */
 #define MAXTOKENLEN 40
 
-/* tokenString array stores the lexeme of each token */
-extern char tokenString[MAXTOKENLEN+1];
-extern char globalId[MAXTOKENLEN+1];
+/* tokenString array stores the lexeme of a token
+ * for the listing, see tokenText
+ */
+extern THREAD_LOCAL char tokenString[MAXTOKENLEN+1];
+
+/* Tokens are spans into sourceText: tokenPos and
+ * tokenLen locate the current token, idPos and
+ * idLen the most recently scanned identifier.
+ * idName is its interned name, or NULL if it has
+ * not been interned yet.
+ */
+extern THREAD_LOCAL long tokenPos;
+extern THREAD_LOCAL int tokenLen;
+extern THREAD_LOCAL long idPos;
+extern THREAD_LOCAL int idLen;
+extern THREAD_LOCAL char * idName;
 
 /* function getToken returns the
  * next token in source file
  */
 TokenType getToken(void);
 
+/* Procedure resetScanner makes the next call to
+ * getToken start scanning again at the beginning
+ * of the source file
+ */
+void resetScanner(void);
+
+/* Procedure scanStream makes getToken scan the
+ * file f, read in pieces as the scanner needs it,
+ * instead of the mapped source file
+ */
+void scanStream(FILE * f);
+
+/* Procedure scanRange makes getToken scan only
+ * the bytes [start,end) of sourceText, which
+ * begin on source line line
+ */
+void scanRange(long start, long end, int line);
+
+/* Function tokenText copies at most MAXTOKENLEN
+ * characters of the current lexeme into
+ * tokenString and returns it
+ */
+char * tokenText(void);
+
+/* Function tokenValue returns the value
+ * of the current NUM token, or INT_MAX if
+ * it does not fit in an int
+ */
+int tokenValue(void);
+
+/* Function identifierName returns the interned
+ * name of the most recently scanned identifier
+ */
+char * identifierName(void);
+
+/* Function tokenName returns the interned
+ * lexeme of the current token
+ */
+char * tokenName(void);
+
 #endif
@@ -1,7 +1,7 @@
 bison -d cminus.y &&
 flex cminus.l &&
 gcc -c *.c &&
-gcc -o cminus *.o -ll &&
+gcc -o cminus *.o -ll -lpthread &&
 mkdir -p results &&
 for file in testfiles/*
 do
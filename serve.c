@@ -0,0 +1,411 @@
+/****************************************************/
+/* File: serve.c                                    */
+/* Compile server and client for the CMINUS         */
+/* compiler over a Unix domain socket               */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "intern.h"
+#include "compiler.h"
+#include "batch.h"
+#include "serve.h"
+
+/* the longest request line: the kind, the length
+ * and a file name
+ */
+#define MAXLINE 4200
+
+/* the number of sources whose answers are kept */
+#define CACHE_SIZE 64
+
+/* the answer to the last request for a source,
+ * with the source it was compiled from
+ */
+typedef struct
+   { char * name;
+     int check;
+     char * text;
+     long len;
+     unsigned long long hash;
+     unsigned long used;  /* the request it last answered */
+     int errors;
+     char * code;
+     size_t codeSize;
+     char * diagnostics;
+     size_t diagnosticsSize;
+   } Answer;
+
+static Answer cache[CACHE_SIZE];
+static unsigned long requests;
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the compilers not in use, for compiling and for
+ * checking, with the blocks of their arenas
+ */
+static Compiler * idle[2];
+static int idleCount[2];
+static int idleSize[2];
+static pthread_mutex_t idleLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int options;
+static char * socketPath;
+
+struct ConnectionRec
+   { int fd;
+     FILE * in;  /* buffers the answers read from fd */
+   };
+
+/* Function sendAll writes the n buffers of v to
+ * fd; returns FALSE if it fails
+ */
+static int sendAll(int fd, struct iovec * v, int n)
+{ while (n > 0)
+  { ssize_t w = writev(fd, v, n);
+    if (w < 0)
+    { if (errno == EINTR) continue;
+      return FALSE;
+    }
+    while (n > 0 && (size_t) w >= v->iov_len)
+    { w -= v->iov_len;
+      v++;
+      n--;
+    }
+    if (n > 0)
+    { v->iov_base = (char *) v->iov_base + w;
+      v->iov_len -= w;
+    }
+  }
+  return TRUE;
+}
+
+/* Function readBuffer returns the next size bytes
+ * of in, NUL terminated, or NULL
+ */
+static char * readBuffer(FILE * in, size_t size)
+{ char * p = (char *) malloc(size + 1);
+  if (p == NULL) return NULL;
+  if (fread(p, 1, size, in) != size)
+  { free(p);
+    return NULL;
+  }
+  p[size] = '\0';
+  return p;
+}
+
+static char * copy(const char * p, size_t size)
+{ char * q = (char *) malloc(size + 1);
+  if (q != NULL)
+  { memcpy(q, p, size);
+    q[size] = '\0';
+  }
+  return q;
+}
+
+/* Function lookup copies the kept answer for the
+ * source to *r; returns FALSE if there is none
+ */
+static int lookup(const char * name, int check, const char * text,
+                  long len, unsigned long long hash, Reply * r)
+{ int i, found = FALSE;
+  pthread_mutex_lock(&cacheLock);
+  for (i = 0; i < CACHE_SIZE && ! found; i++)
+  { Answer * a = &cache[i];
+    if (a->name == NULL || a->hash != hash || a->len != len || a->check != check ||
+        strcmp(a->name, name) != 0 || memcmp(a->text, text, len) != 0)
+      continue;
+    r->errors = a->errors;
+    r->code = copy(a->code, a->codeSize);
+    r->codeSize = a->codeSize;
+    r->diagnostics = copy(a->diagnostics, a->diagnosticsSize);
+    r->diagnosticsSize = a->diagnosticsSize;
+    if (r->code == NULL || r->diagnostics == NULL)
+    { freeReply(r);
+      break;
+    }
+    a->used = ++requests;
+    found = TRUE;
+  }
+  pthread_mutex_unlock(&cacheLock);
+  return found;
+}
+
+static void freeAnswer(Answer * a)
+{ free(a->name);
+  free(a->text);
+  free(a->code);
+  free(a->diagnostics);
+}
+
+/* Procedure keep keeps the answer of c for the
+ * source, in place of that for an earlier version
+ * of it or else of the least recently used one
+ */
+static void keep(Compiler c, const char * name, int check,
+                 const char * text, long len, unsigned long long hash)
+{ Answer a, old;
+  const char * p;
+  int i, k = 0;
+  a.name = copy(name, strlen(name));
+  a.check = check;
+  a.text = copy(text, len);
+  a.len = len;
+  a.hash = hash;
+  a.errors = compilerErrors(c);
+  p = compilerCode(c, &a.codeSize);
+  a.code = copy(p, a.codeSize);
+  p = compilerDiagnostics(c, &a.diagnosticsSize);
+  a.diagnostics = copy(p, a.diagnosticsSize);
+  if (a.name == NULL || a.text == NULL || a.code == NULL || a.diagnostics == NULL)
+  { freeAnswer(&a);
+    return;
+  }
+  pthread_mutex_lock(&cacheLock);
+  for (i = 0; i < CACHE_SIZE; i++)
+  { if (cache[i].name != NULL && cache[i].check == check &&
+        strcmp(cache[i].name, name) == 0)
+    { k = i;
+      break;
+    }
+    if (cache[i].used < cache[k].used) k = i;
+  }
+  old = cache[k];
+  a.used = ++requests;
+  cache[k] = a;
+  pthread_mutex_unlock(&cacheLock);
+  freeAnswer(&old);
+}
+
+/* Function takeCompiler returns an idle compiler
+ * for checking or for compiling, or a new one
+ */
+static Compiler takeCompiler(int check)
+{ Compiler c = NULL;
+  pthread_mutex_lock(&idleLock);
+  if (idleCount[check] > 0) c = idle[check][--idleCount[check]];
+  pthread_mutex_unlock(&idleLock);
+  if (c == NULL) c = newCompiler(options | (check ? CM_CHECK_ONLY : 0));
+  return c;
+}
+
+static void giveCompiler(Compiler c, int check)
+{ pthread_mutex_lock(&idleLock);
+  if (idleCount[check] == idleSize[check])
+  { Compiler * p = (Compiler *) realloc(idle[check], (2 * idleSize[check] + 4) * sizeof(Compiler));
+    if (p != NULL)
+    { idle[check] = p;
+      idleSize[check] = 2 * idleSize[check] + 4;
+    }
+  }
+  if (idleCount[check] < idleSize[check])
+  { idle[check][idleCount[check]++] = c;
+    c = NULL;
+  }
+  pthread_mutex_unlock(&idleLock);
+  freeCompiler(c);
+}
+
+static int sendReply(int fd, int errors, const char * code, size_t codeSize,
+                     const char * diagnostics, size_t diagnosticsSize)
+{ char line[64];
+  struct iovec v[3];
+  v[0].iov_base = line;
+  v[0].iov_len = snprintf(line, sizeof(line), "%d %zu %zu\n",
+                          errors, codeSize, diagnosticsSize);
+  v[1].iov_base = (char *) code;
+  v[1].iov_len = codeSize;
+  v[2].iov_base = (char *) diagnostics;
+  v[2].iov_len = diagnosticsSize;
+  return sendAll(fd, v, 3);
+}
+
+/* Function answer answers a request on fd, from
+ * the kept answers if the source has not changed;
+ * returns FALSE if the connection failed
+ */
+static int answer(int fd, const char * name, int check,
+                  const char * text, long len)
+{ unsigned long long hash = textHash(text, len);
+  Reply r;
+  Compiler c;
+  const char * code, * diagnostics;
+  size_t codeSize, diagnosticsSize;
+  int ok;
+  if (lookup(name, check, text, len, hash, &r))
+  { ok = sendReply(fd, r.errors, r.code, r.codeSize, r.diagnostics, r.diagnosticsSize);
+    freeReply(&r);
+    return ok;
+  }
+  c = takeCompiler(check);
+  if (c == NULL) return FALSE;
+  compileBuffer(c, name, text, len);
+  code = compilerCode(c, &codeSize);
+  diagnostics = compilerDiagnostics(c, &diagnosticsSize);
+  ok = sendReply(fd, compilerErrors(c), code, codeSize, diagnostics, diagnosticsSize);
+  keep(c, name, check, text, len, hash);
+  giveCompiler(c, check);
+  return ok;
+}
+
+/* Procedure session is run by the thread of a
+ * connection: it answers its requests until the
+ * client closes it or sends a bad request
+ */
+static void * session(void * arg)
+{ int fd = (int) (intptr_t) arg;
+  FILE * in = fdopen(fd, "r");
+  char line[MAXLINE];
+  if (in == NULL)
+  { close(fd);
+    return NULL;
+  }
+  while (fgets(line, sizeof(line), in) != NULL)
+  { char kind[8];
+    char * name, * text;
+    long len;
+    int n = 0, ok;
+    name = strchr(line, '\n');
+    if (name == NULL) break;
+    *name = '\0';
+    if (sscanf(line, "%7s %ld %n", kind, &len, &n) != 2 || n == 0 || len < 0 ||
+        (strcmp(kind, "compile") != 0 && strcmp(kind, "check") != 0))
+      break;
+    name = line + n;
+    text = readBuffer(in, len);
+    if (text == NULL) break;
+    ok = answer(fd, name, strcmp(kind, "check") == 0, text, len);
+    free(text);
+    if (! ok) break;
+  }
+  fclose(in);
+  return NULL;
+}
+
+static void stop(int sig)
+{ (void) sig;
+  unlink(socketPath);
+  _exit(0);
+}
+
+int serve(char * path)
+{ struct sockaddr_un addr;
+  struct stat st;
+  pthread_attr_t attr;
+  int fd;
+  if (strlen(path) >= sizeof(addr.sun_path))
+  { fprintf(stderr,"Socket path %s is too long\n",path);
+    return 1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  /* the socket of a server that was killed refuses connections,
+   * while that of a running server must be left to it */
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+  { int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    int dead = probe >= 0 && connect(probe, (struct sockaddr *) &addr, sizeof(addr)) != 0 &&
+               errno == ECONNREFUSED;
+    if (probe >= 0) close(probe);
+    if (!dead)
+    { fprintf(stderr,"%s is already being served\n",path);
+      return 1;
+    }
+    unlink(path);
+  }
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+      listen(fd, 64) != 0)
+  { fprintf(stderr,"Unable to listen on %s\n",path);
+    if (fd >= 0) close(fd);
+    return 1;
+  }
+  socketPath = path;
+  options = commandOptions();
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (;;)
+  { pthread_t thread;
+    int c = accept(fd, NULL, NULL);
+    if (c < 0)
+    { if (errno == EINTR || errno == ECONNABORTED) continue;
+      fprintf(stderr,"Unable to accept on %s\n",path);
+      break;
+    }
+    if (pthread_create(&thread, &attr, session, (void *) (intptr_t) c) != 0)
+      close(c);
+  }
+  pthread_attr_destroy(&attr);
+  close(fd);
+  unlink(path);
+  return 1;
+}
+
+Connection connectServer(char * path)
+{ struct sockaddr_un addr;
+  Connection c;
+  int fd;
+  if (strlen(path) >= sizeof(addr.sun_path)) return NULL;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return NULL;
+  c = (Connection) malloc(sizeof(struct ConnectionRec));
+  if (c == NULL || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+      (c->in = fdopen(fd, "r")) == NULL)
+  { free(c);
+    close(fd);
+    return NULL;
+  }
+  c->fd = fd;
+  return c;
+}
+
+int request(Connection c, int check, const char * name,
+            const char * text, long len, Reply * r)
+{ char line[MAXLINE];
+  struct iovec v[2];
+  int n = snprintf(line, sizeof(line), "%s %ld %s\n",
+                   check ? "check" : "compile", len, name);
+  memset(r, 0, sizeof(Reply));
+  if (n < 0 || n >= (int) sizeof(line) || strchr(name, '\n') != NULL) return FALSE;
+  v[0].iov_base = line;
+  v[0].iov_len = n;
+  v[1].iov_base = (char *) text;
+  v[1].iov_len = len;
+  if (! sendAll(c->fd, v, 2) || fgets(line, sizeof(line), c->in) == NULL ||
+      sscanf(line, "%d %zu %zu", &r->errors, &r->codeSize, &r->diagnosticsSize) != 3)
+    return FALSE;
+  r->code = readBuffer(c->in, r->codeSize);
+  r->diagnostics = readBuffer(c->in, r->diagnosticsSize);
+  if (r->code == NULL || r->diagnostics == NULL)
+  { freeReply(r);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void freeReply(Reply * r)
+{ free(r->code);
+  free(r->diagnostics);
+  r->code = r->diagnostics = NULL;
+}
+
+void closeConnection(Connection c)
+{ if (c == NULL) return;
+  fclose(c->in);
+  free(c);
+}
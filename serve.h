@@ -0,0 +1,74 @@
+/****************************************************/
+/* File: serve.h                                    */
+/* Compile server and client for the CMINUS         */
+/* compiler over a Unix domain socket               */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _SERVE_H_
+#define _SERVE_H_
+
+#include <stddef.h>
+
+/* A client sends requests on a connection, each a
+ * line followed by the len bytes of the source:
+ *
+ *   compile <len> <name>
+ *   check <len> <name>
+ *
+ * where name is the file name the code is marked
+ * with. A check stops after type checking. The
+ * server answers each request with a line
+ *
+ *   <errors> <code length> <diagnostics length>
+ *
+ * followed by the code and the diagnostics, as
+ * compilerCode and compilerDiagnostics return them.
+ */
+
+/* the answer to a request */
+typedef struct
+   { int errors;
+     char * code;
+     size_t codeSize;
+     char * diagnostics;
+     size_t diagnosticsSize;
+   } Reply;
+
+typedef struct ConnectionRec * Connection;
+
+/* Function serve listens on the Unix domain socket
+ * path and answers requests, each connection on a
+ * thread of its own, with the options of the
+ * command line, until it is interrupted or
+ * terminated. Compilers and their memory are kept
+ * from one request to the next, and so are the
+ * answers to the last sources compiled, which are
+ * sent again while a source does not change.
+ * Returns only if the socket cannot be set up.
+ */
+int serve(char * path);
+
+/* Function connectServer returns a connection to
+ * the server listening on path, or NULL
+ */
+Connection connectServer(char * path);
+
+/* Function request sends the len bytes of source
+ * at text to be compiled, or only checked, and
+ * waits for the answer in *r; returns FALSE if the
+ * connection failed
+ */
+int request(Connection c, int check, const char * name,
+            const char * text, long len, Reply * r);
+
+/* Procedure freeReply frees the code and the
+ * diagnostics of r
+ */
+void freeReply(Reply * r);
+
+/* Procedure closeConnection closes c */
+void closeConnection(Connection c);
+
+#endif
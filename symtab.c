@@ -1,27 +1,63 @@
 /****************************************************/
 /* File: symtab.c                                   */
 /* Symbol table implementation for the TINY compiler*/
-/* (allows only one symbol table)                   */
-/* Symbol table is implemented as a chained         */
-/* hash table                                       */
+/* (one symbol table per thread, sharing a          */
+/* published global scope)                          */
+/* Symbol table is implemented as a stack of       */
+/* scopes over an open addressing hash table of     */
+/* names, with SwissTable-style control bytes       */
+/* probed a group at a time. The global scope can  */
+/* be published for lock-free reads by threads     */
+/* that keep their local scopes in tables of their */
+/* own                                              */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
 /****************************************************/
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#include "globals.h"
+#include "arena.h"
+#include "intern.h"
 #include "symtab.h"
+#include <stdatomic.h>
 
-/* SIZE is the size of the hash table */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* SIZE is the modulus of the listing order */
 #define SIZE 211
 
+/* GROUP is the number of slots probed at once;
+ * MINSLOTS is the size of a new table, which
+ * doubles when it is more than 7/8 full
+ */
+#define GROUP 16
+#define MINSLOTS 256
+
+/* the control byte of an empty slot; a full slot
+ * holds the low 7 bits of the hash of its name
+ */
+#define EMPTY 0x80
+
 /* SHIFT is the power of two used as multiplier
-   in hash function  */
+   in the listing order function  */
 #define SHIFT 4
 
-/* the hash function */
-static int hash ( char * firstKey, char * secondKey)
+/* the hash function: names are interned, so
+ * their hashes are already known
+ */
+static unsigned long long hash ( char * name )
+{ unsigned long long h = nameHash(name);
+  h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDULL;
+  return h ^ (h >> 33);
+}
+
+/* the listing order function: printSymTab lists
+ * the symbols in the order of this function, as
+ * earlier versions of the table did. It is
+ * computed once for each new symbol.
+ */
+static int listingOrder ( char * firstKey, char * secondKey)
 { int temp = 0;
   int i = 0;
   while (firstKey[i] != '\0')
@@ -37,83 +73,719 @@ static int hash ( char * firstKey, char * secondKey)
   return temp;
 }
 
-/* the list of line numbers of the source 
- * code in which a variable is referenced
+/* LINEBYTES is the room for line numbers kept
+ * in the record itself; most symbols need no more
+ */
+#define LINEBYTES 8
+
+/* the line numbers of the source code in which
+ * a variable is referenced, in order: each is
+ * stored as its difference from the one before,
+ * zigzag encoded and written as a varint of 7
+ * bits per byte. The bytes move to a block of
+ * the arena twice their size when they fill.
  */
-typedef struct LineListRec
-   { int lineno;
-     struct LineListRec * next;
-   } * LineList;
+typedef struct
+   { unsigned char * bytes;
+     int used;
+     int size;
+     int last; /* the last line added */
+   } LineList;
 
-/* The record in the bucket lists for
- * each variable, including name, 
- * assigned memory location, and
- * the list of line numbers in which
- * it appears in the source code
+/* The record for each variable,
+ * including name, assigned memory
+ * location, and the list of line
+ * numbers in which it appears in
+ * the source code
  */
 typedef struct BucketListRec
    { char * name;
-     LineList lines;
+     LineList lines; /* declarations and assignments, as listed */
+     LineList uses;  /* other uses, if st_recordUses is on */
+     unsigned char firstLines[LINEBYTES]; /* the first bytes of lines */
      int memloc ; /* memory location for variable */
      int decl;
      int type;
-     char *scope;
-     struct BucketListRec * next;
+     char *scope; /* function of its scope, for the listing */
+     int order; /* listingOrder of name and scope */
+     int seq;   /* number of symbols inserted before */
+     int unit;  /* the unit it was declared in, or -1 */
+     int scopeId; /* the scope it is declared in */
+     struct BucketListRec * shadowed; /* the binding of name it hides */
+     struct BucketListRec * next; /* the next symbol inserted */
    } * BucketList;
 
-/* the hash table */
-static BucketList hashTable[SIZE];
-
-/* Procedure st_insert inserts line numbers and
- * memory locations into the symbol table
- * loc = memory location is inserted only the
- * first time, otherwise ignored
- */
-void st_insert( char * name, int lineno, int loc, int decl, int type, char *scope)
-{ int h = hash(name, scope);
-  BucketList l =  hashTable[h];
-  while ((l != NULL) && (strcmp(name,l->name) != 0))
-    l = l->next;
-  if (l == NULL) /* variable not yet in table */
-  { l = (BucketList) malloc(sizeof(struct BucketListRec));
-    l->name = name;
-    l->lines = (LineList) malloc(sizeof(struct LineListRec));
-    l->lines->lineno = lineno;
-    l->memloc = loc;
-    l->decl = decl;
-    l->type = type;
-    l->scope = scope;
-    l->lines->next = NULL;
-    l->next = hashTable[h];
-    hashTable[h] = l; }
-  else /* found in table, so just add line number */
-  { LineList t = l->lines;
-    while (t->next != NULL) t = t->next;
-    t->next = (LineList) malloc(sizeof(struct LineListRec));
-    t->next->lineno = lineno;
-    t->next->next = NULL;
-  }
-} /* st_insert */
+/* a scope: the function it belongs to, its
+ * number and the height of the undo stack when
+ * it was entered. The global scope is number 0.
+ */
+typedef struct
+   { char * name;
+     int id;
+     int undo;
+   } Scope;
+
+/* a line added to a symbol of another unit,
+ * kept until the units are put in order
+ */
+typedef struct
+   { BucketList symbol;
+     int line;
+     int use; /* TRUE: a use, FALSE: a listed line */
+   } LoggedLine;
+
+/* a symbol table. Its names are kept in ctrl,
+ * keys and bindings: the control bytes, names
+ * and innermost bindings of slotCount slots.
+ * ctrl has GROUP more bytes that mirror its first
+ * ones, so that a group starting at any slot can
+ * be loaded at once. A name stays in the table
+ * when its scopes are left; its binding is then
+ * NULL. undo holds the slots whose binding each
+ * open scope has pushed.
+ */
+typedef struct
+   { unsigned char * ctrl;
+     char ** keys;
+     BucketList * bindings;
+     int slotCount;
+     int nameCount;
+     /* all symbols, in the order they were inserted */
+     BucketList firstSymbol;
+     BucketList lastSymbol;
+     int symbols;
+     /* the stack of open scopes */
+     Scope * scopes;
+     int depth;
+     int scopeSize;
+     int lastId;
+     int * undo;
+     int undoCount;
+     int undoSize;
+     /* the unit being analyzed, or -1: see st_beginUnit */
+     int unit;
+     BucketList unitMark; /* lastSymbol when it began */
+     int unitSymbols;     /* symbols when it began */
+     LoggedLine * log;
+     int logCount;
+     int logSize;
+     /* statistics of the table for st_printStats */
+     long lookups;    /* searches for a name */
+     long probes;     /* groups examined by them */
+     long collisions; /* other names with a matching control byte */
+     int longestProbe; /* most groups examined by one search */
+     int rehashes;
+     int maxDepth;
+   } SymTab;
+
+/* the table of the compiler, and the table of
+ * this thread: the compiler's unless the thread
+ * has called st_beginThread
+ */
+static SymTab mainTable = { .unit = -1 };
+static THREAD_LOCAL SymTab * tab = &mainTable;
+
+/* the global scope once st_publish has frozen
+ * it: only its ctrl, keys, bindings and slotCount
+ * are used, and they never change. publisher is
+ * the table it was copied from.
+ */
+static SymTab * _Atomic published = NULL;
+static SymTab * publisher = NULL;
+
+static void * growArray(void * p, int * size, int width)
+{ *size = *size ? 2 * *size : 64;
+  p = realloc(p, (size_t) *size * width);
+  if (p == NULL)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    exit(1);
+  }
+  return p;
+}
+
+/* Function current returns the innermost open
+ * scope, opening the global scope if need be
+ */
+static Scope * current(void)
+{ SymTab * t = tab;
+  if (t->depth == 0)
+  { if (t->scopeSize == 0) t->scopes = (Scope *) growArray(t->scopes, &t->scopeSize, sizeof(Scope));
+    t->scopes[0].name = nameGlobal;
+    t->scopes[0].id = 0;
+    t->scopes[0].undo = 0;
+    t->depth = 1;
+  }
+  return &t->scopes[t->depth - 1];
+}
+
+/* Function matchGroup returns a bit mask of the
+ * slots of the group at ctrl[i] whose control
+ * byte is c
+ */
+static unsigned matchGroup(const unsigned char * ctrl, int i, unsigned char c)
+{
+#if defined(__SSE2__)
+  __m128i g = _mm_loadu_si128((const __m128i *) (ctrl + i));
+  return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char) c)));
+#else
+  unsigned m = 0;
+  int k;
+  for (k = 0; k < GROUP; k++)
+    if (ctrl[i + k] == c) m |= 1u << k;
+  return m;
+#endif
+}
+
+/* Procedure setCtrl sets the control byte of
+ * slot i of table t and of its mirror
+ */
+static void setCtrl(SymTab * t, int i, unsigned char c)
+{ t->ctrl[i] = c;
+  if (i < GROUP) t->ctrl[t->slotCount + i] = c;
+}
+
+/* Function findSlot returns the slot of table t
+ * holding name, or the empty slot where it
+ * belongs. The probe visits a group at a time,
+ * each further away than the last, from the slot
+ * chosen by the high bits of the hash. It is
+ * counted in the statistics of this thread's
+ * table, as t may be the published one.
+ */
+static int findSlot ( const SymTab * t, char * name, unsigned long long h )
+{ SymTab * st = tab;
+  unsigned char tag = (unsigned char) (h & 0x7F);
+  int mask = t->slotCount - 1;
+  int i = (int) (h >> 7) & mask;
+  int step = 0;
+  st->lookups++;
+  for (;;)
+  { unsigned m = matchGroup(t->ctrl, i, tag);
+    unsigned e;
+    st->probes++;
+    step++;
+    while (m != 0)
+    { int k = (i + __builtin_ctz(m)) & mask;
+      if (t->keys[k] == name)
+      { if (step > st->longestProbe) st->longestProbe = step;
+        return k;
+      }
+      st->collisions++;
+      m &= m - 1;
+    }
+    e = matchGroup(t->ctrl, i, EMPTY);
+    if (e != 0)
+    { if (step > st->longestProbe) st->longestProbe = step;
+      return (i + __builtin_ctz(e)) & mask;
+    }
+    i = (i + step * GROUP) & mask;
+  }
+}
+
+/* Procedure resize makes a table of n slots and
+ * enters the names of the old one into it; the
+ * slots on the undo stack are renumbered
+ */
+static void resize(SymTab * t, int n)
+{ unsigned char * oldCtrl = t->ctrl;
+  char ** oldKeys = t->keys;
+  BucketList * oldBindings = t->bindings;
+  int * moved;
+  int oldCount = t->slotCount;
+  int i;
+  t->ctrl = (unsigned char *) malloc(n + GROUP);
+  t->keys = (char **) malloc(n * sizeof(char *));
+  t->bindings = (BucketList *) malloc(n * sizeof(BucketList));
+  moved = (int *) malloc((oldCount + 1) * sizeof(int));
+  if (t->ctrl == NULL || t->keys == NULL || t->bindings == NULL || moved == NULL)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    exit(1);
+  }
+  memset(t->ctrl, EMPTY, n + GROUP);
+  t->slotCount = n;
+  for (i = 0; i < oldCount; i++)
+    if (oldCtrl[i] != EMPTY)
+    { unsigned long long h = hash(oldKeys[i]);
+      int k = findSlot(t, oldKeys[i], h);
+      setCtrl(t, k, (unsigned char) (h & 0x7F));
+      t->keys[k] = oldKeys[i];
+      t->bindings[k] = oldBindings[i];
+      moved[i] = k;
+    }
+  for (i = 0; i < t->undoCount; i++) t->undo[i] = moved[t->undo[i]];
+  if (oldCount > 0) t->rehashes++;
+  free(moved);
+  free(oldCtrl);
+  free(oldKeys);
+  free(oldBindings);
+}
+
+/* Function nameSlot returns the slot of name,
+ * entering name into the table if it is new
+ */
+static int nameSlot ( SymTab * t, char * name )
+{ unsigned long long h = hash(name);
+  int k;
+  if (8 * (t->nameCount + 1) > 7 * t->slotCount)
+    resize(t, t->slotCount ? 2 * t->slotCount : MINSLOTS);
+  k = findSlot(t, name, h);
+  if (t->ctrl[k] == EMPTY)
+  { setCtrl(t, k, (unsigned char) (h & 0x7F));
+    t->keys[k] = name;
+    t->bindings[k] = NULL;
+    t->nameCount++;
+  }
+  return k;
+}
+
+/* Function findGlobal returns the published
+ * global binding of name, or NULL if there is
+ * none or this thread's table holds the global
+ * scope itself
+ */
+static BucketList findGlobal ( char * name )
+{ SymTab * g = atomic_load_explicit(&published, memory_order_acquire);
+  BucketList l;
+  int k;
+  if (g == NULL || tab == publisher || g->slotCount == 0) return NULL;
+  k = findSlot(g, name, hash(name));
+  l = g->ctrl[k] == EMPTY ? NULL : g->bindings[k];
+  /* a unit does not see the globals of later ones */
+  if (l != NULL && tab->unit >= 0 && l->unit > tab->unit) l = NULL;
+  return l;
+}
+
+/* Function st_select returns the binding that
+ * where selects among the binding s, which must
+ * be visible, and those it shadows, or NULL
+ */
+BucketList st_select ( BucketList l, int where )
+{ if (where == ST_LOCAL)
+  { if (l != NULL && l->scopeId != current()->id) l = NULL;
+  }
+  else if (where == ST_GLOBAL)
+  { char * name = l != NULL ? l->name : NULL;
+    while (l != NULL && l->scopeId != 0) l = l->shadowed;
+    /* the global scope may be the published one */
+    if (l == NULL && name != NULL) l = findGlobal(name);
+  }
+  return l;
+}
+
+/* Function st_find returns the binding of name
+ * that where selects, or NULL if there is none;
+ * a thread with a table of its own looks in the
+ * published global scope for the names it does
+ * not bind itself
+ */
+BucketList st_find ( char * name, int where )
+{ SymTab * t = tab;
+  if (t->slotCount > 0)
+  { int k = findSlot(t, name, hash(name));
+    if (t->ctrl[k] != EMPTY && t->bindings[k] != NULL)
+      return st_select(t->bindings[k], where);
+  }
+  if (where == ST_LOCAL && current()->id != 0) return NULL;
+  return findGlobal(name);
+}
+
+/* recordUses = TRUE keeps the uses of symbols */
+static int recordUses = FALSE;
+
+/* a unit of the analysis cut off the table by
+ * st_endUnit: its symbols in the order they were
+ * inserted, and the lines it added to the
+ * symbols of other units
+ */
+struct StUnitRec
+   { BucketList first;
+     BucketList last;
+     int symbols;
+     LoggedLine * log;
+     int logCount;
+   };
+
+/* Function logLine keeps line of symbol l for
+ * st_addUnit if l belongs to another unit than
+ * the one being analyzed, and returns TRUE if
+ * so: the symbols of other units are only read
+ */
+static int logLine ( BucketList l, int line, int use )
+{ SymTab * t = tab;
+  if (t->unit < 0 || l->unit == t->unit) return FALSE;
+  if (t->logCount == t->logSize)
+    t->log = (LoggedLine *) growArray(t->log, &t->logSize, sizeof(LoggedLine));
+  t->log[t->logCount].symbol = l;
+  t->log[t->logCount].line = line;
+  t->log[t->logCount].use = use;
+  t->logCount++;
+  return TRUE;
+}
+
+/* Procedure appendLine adds lineno to the
+ * line list t
+ */
+static void appendLine ( LineList * t, int lineno )
+{ int d = lineno - t->last;
+  unsigned z = ((unsigned) d << 1) ^ (unsigned) (d >> 31);
+  if (t->used + 5 > t->size)
+  { int size = t->size ? 2 * t->size : LINEBYTES;
+    unsigned char * b = (unsigned char *) arenaAlloc(currentArena, size);
+    if (t->used > 0) memcpy(b, t->bytes, t->used);
+    t->bytes = b;
+    t->size = size;
+  }
+  while (z >= 0x80)
+  { t->bytes[t->used++] = (unsigned char) (z | 0x80);
+    z >>= 7;
+  }
+  t->bytes[t->used++] = (unsigned char) z;
+  t->last = lineno;
+}
+
+/* Procedure st_addLine adds a line number
+ * to the record of symbol l
+ */
+void st_addLine ( BucketList l, int lineno )
+{ if (!logLine(l, lineno, FALSE)) appendLine(&l->lines, lineno);
+}
+
+/* Procedure st_addUse adds the line of a use
+ * of symbol l that the listing does not show
+ */
+void st_addUse ( BucketList l, int lineno )
+{ if (recordUses && !logLine(l, lineno, TRUE)) appendLine(&l->uses, lineno);
+}
+
+/* Procedure st_addUseOf adds the line of a use
+ * of the visible binding of name, which is only
+ * looked up if uses are recorded
+ */
+void st_addUseOf ( char * name, int lineno )
+{ BucketList l;
+  if (!recordUses) return;
+  l = st_find(name, ST_VISIBLE);
+  if (l != NULL) st_addUse(l, lineno);
+}
+
+/* Procedure st_recordUses turns the recording
+ * of uses by st_addUse on or off
+ */
+void st_recordUses ( int on )
+{ recordUses = on;
+}
+
+/* Function nextLine decodes the line at *pos of
+ * the line list t that follows line prev
+ */
+static int nextLine ( LineList * t, int * pos, int prev )
+{ unsigned z = 0;
+  int shift = 0;
+  unsigned char c;
+  do
+  { c = t->bytes[(*pos)++];
+    z |= (unsigned) (c & 0x7F) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return prev + (int) ((z >> 1) ^ -(z & 1));
+}
+
+int st_memloc ( BucketList l )
+{ return l == NULL ? -1 : l->memloc;
+}
+
+void st_setMemloc ( BucketList l, int loc )
+{ l->memloc = loc;
+}
+
+int st_decl ( BucketList l )
+{ return l == NULL ? -1 : l->decl;
+}
+
+int st_type ( BucketList l )
+{ return l == NULL ? -1 : l->type;
+}
+
+char * st_name ( BucketList l )
+{ return l->name;
+}
+
+char * st_scope ( BucketList l )
+{ return l->scope;
+}
+
+const unsigned char * st_lines ( BucketList l, int * n )
+{ *n = l->lines.used;
+  return l->lines.bytes;
+}
+
+const unsigned char * st_uses ( BucketList l, int * n )
+{ *n = l->uses.used;
+  return l->uses.bytes;
+}
+
+BucketList st_first ( void )
+{ return tab->firstSymbol;
+}
+
+BucketList st_next ( BucketList l )
+{ return l->next;
+}
+
+/* Procedure st_enterScope opens a scope inside
+ * the current one; its symbols are listed under
+ * function name, or under the function of the
+ * enclosing scope if name is NULL
+ */
+void st_enterScope( char * name )
+{ SymTab * t = tab;
+  Scope * s = current();
+  if (name == NULL) name = s->name;
+  if (t->depth == t->scopeSize) t->scopes = (Scope *) growArray(t->scopes, &t->scopeSize, sizeof(Scope));
+  s = &t->scopes[t->depth++];
+  s->name = name;
+  s->id = ++t->lastId;
+  s->undo = t->undoCount;
+  if (t->depth > t->maxDepth) t->maxDepth = t->depth;
+}
+
+/* Procedure st_exitScope closes the current
+ * scope, uncovering the bindings its symbols hid
+ */
+void st_exitScope(void)
+{ SymTab * t = tab;
+  Scope * s = current();
+  if (t->depth == 1) return; /* the global scope stays open */
+  while (t->undoCount > s->undo)
+  { int k = t->undo[--t->undoCount];
+    t->bindings[k] = t->bindings[k]->shadowed;
+  }
+  t->depth--;
+}
+
+/* Function st_declare declares name in the
+ * current scope, or adds lineno to its record
+ * if it is already declared there, and returns
+ * the record
+ */
+BucketList st_declare( char * name, int lineno, int loc, int decl, int type )
+{ SymTab * t = tab;
+  Scope * s = current();
+  int k = nameSlot(t, name);
+  BucketList l = t->bindings[k];
+  if (l != NULL && l->scopeId == s->id)
+  { st_addLine(l, lineno);
+    return l;
+  }
+  l = (BucketList) arenaAlloc(currentArena, sizeof(struct BucketListRec));
+  l->name = name;
+  l->order = listingOrder(name, s->name);
+  l->seq = t->symbols++;
+  l->unit = t->unit;
+  l->lines.bytes = l->firstLines;
+  l->lines.used = 0;
+  l->lines.size = LINEBYTES;
+  l->lines.last = 0;
+  memset(&l->uses, 0, sizeof(LineList));
+  st_addLine(l, lineno);
+  l->memloc = loc;
+  l->decl = decl;
+  l->type = type;
+  l->scope = s->name;
+  l->scopeId = s->id;
+  l->shadowed = t->bindings[k];
+  l->next = NULL;
+  t->bindings[k] = l;
+  if (t->lastSymbol == NULL) t->firstSymbol = l;
+  else t->lastSymbol->next = l;
+  t->lastSymbol = l;
+  if (s->id != 0)
+  { if (t->undoCount == t->undoSize) t->undo = (int *) growArray(t->undo, &t->undoSize, sizeof(int));
+    t->undo[t->undoCount++] = k;
+  }
+  return l;
+}
+
+/* Procedure st_clear empties the symbol table;
+ * its records belong to the arena of the
+ * compilation and are released with it
+ */
+void st_clear(void)
+{ SymTab * t = tab;
+  if (t == publisher) st_unpublish();
+  free(t->ctrl);
+  free(t->keys);
+  free(t->bindings);
+  free(t->scopes);
+  free(t->undo);
+  free(t->log);
+  memset(t, 0, sizeof(SymTab));
+  t->unit = -1;
+}
+
+/* Procedure st_publish freezes the global scope
+ * of this thread's table and publishes it to the
+ * threads with tables of their own. No scope but
+ * the global one may be open.
+ */
+void st_publish(void)
+{ SymTab * t = tab;
+  SymTab * g = (SymTab *) calloc(1, sizeof(SymTab));
+  int n = t->slotCount;
+  if (g == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  st_unpublish();
+  if (n > 0)
+  { g->ctrl = (unsigned char *) malloc(n + GROUP);
+    g->keys = (char **) malloc(n * sizeof(char *));
+    g->bindings = (BucketList *) malloc(n * sizeof(BucketList));
+    if (g->ctrl == NULL || g->keys == NULL || g->bindings == NULL)
+    { fprintf(listing,"Out of memory error\n");
+      exit(1);
+    }
+    memcpy(g->ctrl, t->ctrl, n + GROUP);
+    memcpy(g->keys, t->keys, n * sizeof(char *));
+    memcpy(g->bindings, t->bindings, n * sizeof(BucketList));
+  }
+  g->slotCount = n;
+  publisher = t;
+  atomic_store_explicit(&published, g, memory_order_release);
+}
+
+/* Procedure st_unpublish withdraws the published
+ * global scope; no other thread may be reading it
+ */
+void st_unpublish(void)
+{ SymTab * g = atomic_exchange_explicit(&published, NULL, memory_order_acq_rel);
+  if (g != NULL)
+  { free(g->ctrl);
+    free(g->keys);
+    free(g->bindings);
+    free(g);
+  }
+  publisher = NULL;
+}
+
+/* Procedure st_beginThread gives the calling
+ * thread an empty table of its own, whose global
+ * scope is the published one
+ */
+void st_beginThread(void)
+{ /* whole cache lines: the statistics are written
+   * on every lookup, and must not share a line
+   * with the table of another thread
+   */
+  size_t size = (sizeof(SymTab) + 63) & ~(size_t) 63;
+  SymTab * t = (SymTab *) aligned_alloc(64, size);
+  if (t == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  memset(t, 0, size);
+  t->unit = -1;
+  tab = t;
+}
+
+/* Procedure st_endThread frees the table of the
+ * calling thread, which goes back to the table
+ * of the compiler; its records belong to the
+ * arena they were allocated from
+ */
+void st_endThread(void)
+{ if (tab == &mainTable) return;
+  st_clear();
+  free(tab);
+  tab = &mainTable;
+}
+
+/* Procedure st_beginUnit starts unit number unit
+ * of an analysis split into units, such as the
+ * top-level declarations of a program. Until
+ * st_endUnit, the symbols declared belong to the
+ * unit, lines added to symbols of other units are
+ * kept aside, and the published globals of later
+ * units are not seen.
+ */
+void st_beginUnit ( int unit )
+{ SymTab * t = tab;
+  t->unit = unit;
+  t->unitMark = t->lastSymbol;
+  t->unitSymbols = t->symbols;
+  t->logCount = 0;
+}
+
+/* Function st_endUnit ends the unit begun by
+ * st_beginUnit and takes its symbols and the
+ * lines kept aside off the table
+ */
+StUnit st_endUnit ( void )
+{ SymTab * t = tab;
+  StUnit u = (StUnit) malloc(sizeof(struct StUnitRec));
+  if (u == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  u->first = t->unitMark != NULL ? t->unitMark->next : t->firstSymbol;
+  u->last = u->first != NULL ? t->lastSymbol : NULL;
+  u->symbols = t->symbols - t->unitSymbols;
+  if (t->unitMark != NULL) t->unitMark->next = NULL;
+  else t->firstSymbol = NULL;
+  t->lastSymbol = t->unitMark;
+  t->symbols = t->unitSymbols;
+  u->log = NULL;
+  u->logCount = t->logCount;
+  if (t->logCount > 0)
+  { u->log = (LoggedLine *) malloc(t->logCount * sizeof(LoggedLine));
+    if (u->log == NULL)
+    { fprintf(listing,"Out of memory error\n");
+      exit(1);
+    }
+    memcpy(u->log, t->log, t->logCount * sizeof(LoggedLine));
+  }
+  t->unit = -1;
+  t->logCount = 0;
+  return u;
+}
+
+/* Procedure st_addUnit appends the symbols of
+ * unit u to this thread's table as if they had
+ * just been inserted, adds the lines it kept
+ * aside, and frees u. Units added in the order
+ * of their numbers leave the table as if their
+ * analysis had not been split.
+ */
+void st_addUnit ( StUnit u )
+{ SymTab * t = tab;
+  BucketList l;
+  int i;
+  for (l = u->first; l != NULL; l = l->next)
+    l->seq = t->symbols++;
+  if (u->first != NULL)
+  { if (t->lastSymbol == NULL) t->firstSymbol = u->first;
+    else t->lastSymbol->next = u->first;
+    t->lastSymbol = u->last;
+  }
+  for (i = 0; i < u->logCount; i++)
+  { LoggedLine * g = &u->log[i];
+    if (g->use) st_addUse(g->symbol, g->line);
+    else st_addLine(g->symbol, g->line);
+  }
+  free(u->log);
+  free(u);
+}
 
 /* Function st_lookup returns the memory 
- * location of a variable or -1 if not found
+ * location of the binding of name that where
+ * selects, or -1 if not found
  */
-int st_lookup ( char * name, char * scope )
-{ int h = hash(name, scope);
-  BucketList l =  hashTable[h];
-  while ((l != NULL) && (strcmp(name,l->name) != 0))
-    l = l->next;
-  if (l == NULL) return -1;
-  else return l->memloc;
+int st_lookup ( char * name, int where )
+{ return st_memloc(st_find(name, where));
 }
 
-int st_lookup_decl ( char * name, char * scope)
-{ int h = hash(name, scope);
-  BucketList l =  hashTable[h];
-  while ((l != NULL) && (strcmp(name,l->name) != 0))
-    l = l->next;
-  if (l == NULL) return -1;
-  else return l->decl;
+int st_lookup_decl ( char * name, int where )
+{ return st_decl(st_find(name, where));
 }
 
 /* Procedure printSymTab prints a formatted 
@@ -147,51 +819,68 @@ char *convertTypeToMessage (int type) {
 }
 
 
+/* Function compareListing orders symbols by
+ * listingOrder, the latest inserted first
+ */
+static int compareListing(const void * a, const void * b)
+{ BucketList l1 = *(BucketList *) a;
+  BucketList l2 = *(BucketList *) b;
+  if (l1->order != l2->order) return l1->order - l2->order;
+  return l2->seq - l1->seq;
+}
+
 void printSymTab(FILE * listing)
-{ int i;
+{ int i, n = 0;
+  BucketList * all = (BucketList *) malloc((tab->symbols + 1) * sizeof(BucketList));
   fprintf(listing,"Variable Name Location   Escopo   Tipo ID Tipo Dado Line Numbers\n");
   fprintf(listing,"------------- -------- ---------- ------- --------- ------------\n");
-  for (i=0;i<SIZE;++i)
-  { if (hashTable[i] != NULL)
-    { BucketList l = hashTable[i];
-      while (l != NULL)
-      { LineList t = l->lines;
-        fprintf(listing,"%-14s ",l->name);
-        fprintf(listing,"%-8d  ",l->memloc);
-        fprintf(listing,"%-7s  ",l->scope);
-        fprintf(listing,"%-7s  ",convertDeclToMessage(l->decl));
-        fprintf(listing,"%-7s  ",convertTypeToMessage(l->type));
-        while (t != NULL)
-        { fprintf(listing,"%4d ",t->lineno);
-          t = t->next;
-        }
-        fprintf(listing,"\n");
-        l = l->next;
-      }
+  { BucketList l;
+    for (l = tab->firstSymbol; l != NULL; l = l->next) all[n++] = l;
+  }
+  qsort(all, n, sizeof(BucketList), compareListing);
+  for (i=0;i<n;++i)
+  { BucketList l = all[i];
+    int pos = 0, line = 0;
+    fprintf(listing,"%-14s ",l->name);
+    fprintf(listing,"%-8d  ",l->memloc);
+    fprintf(listing,"%-7s  ",l->scope);
+    fprintf(listing,"%-7s  ",convertDeclToMessage(l->decl));
+    fprintf(listing,"%-7s  ",convertTypeToMessage(l->type));
+    while (pos < l->lines.used)
+    { line = nextLine(&l->lines, &pos, line);
+      fprintf(listing,"%4d ",line);
     }
+    fprintf(listing,"\n");
   }
+  free(all);
 } /* printSymTab */
 
 void printErrors(FILE * listing)
-{ int i;
+{ BucketList l;
   int no_main = 0;
-  for (i=0;i<SIZE;++i)
-  { if (hashTable[i] != NULL)
-    { BucketList l = hashTable[i];
-      while (l != NULL)
-      { LineList t = l->lines;
-        if (strcmp(l->name, "main") == 0 && l->decl == 2){
-          no_main = 1;
-        }
-        while (t != NULL)
-        {
-          t = t->next;
-        }
-        l = l->next;
-      }
+  for (l = tab->firstSymbol; l != NULL; l = l->next)
+  { if (l->name == nameMain && l->decl == 2){
+      no_main = 1;
     }
   }
   if (no_main == 0){
-    printf("Erro semantico: funcao main() não declarada\n");
+    fprintf(listing,"Erro semantico: funcao main() não declarada\n");
   }
 }
+
+/* Procedure st_printStats prints the size, load,
+ * scope and probe statistics of the table
+ */
+void st_printStats(FILE * f)
+{ SymTab * t = tab;
+  fprintf(f,"%-12s %10d\n","symbols",t->symbols);
+  fprintf(f,"%-12s %10d\n","names",t->nameCount);
+  fprintf(f,"%-12s %10d\n","slots",t->slotCount);
+  fprintf(f,"%-12s %10d\n","scopes",t->lastId);
+  fprintf(f,"%-12s %10d\n","max depth",t->maxDepth);
+  fprintf(f,"%-12s %10d\n","rehashes",t->rehashes);
+  fprintf(f,"%-12s %10ld\n","lookups",t->lookups);
+  fprintf(f,"%-12s %10.3f\n","groups/look",t->lookups ? (double) t->probes / t->lookups : 0.0);
+  fprintf(f,"%-12s %10d\n","max groups",t->longestProbe);
+  fprintf(f,"%-12s %10ld\n","collisions",t->collisions);
+}
@@ -1,7 +1,8 @@
 /****************************************************/
 /* File: symtab.h                                   */
 /* Symbol table interface for the TINY compiler     */
-/* (allows only one symbol table)                   */
+/* (one symbol table per thread, sharing a          */
+/* published global scope)                          */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
 /****************************************************/
@@ -9,19 +10,185 @@
 #ifndef _SYMTAB_H_
 #define _SYMTAB_H_
 
-/* Procedure st_insert inserts line numbers and
- * memory locations into the symbol table
- * loc = memory location is inserted only the
- * first time, otherwise ignored
+/* Symbols are keyed on name, which must be
+ * interned (see intern.h). Each name is bound to
+ * its declaration in the innermost open scope
+ * that declares it; the global scope is always
+ * open.
+ *
+ * Threads share the table of the compiler unless
+ * they call st_beginThread. A thread with a table
+ * of its own declares its symbols in it and finds
+ * the global symbols in the global scope that
+ * another thread has published with st_publish,
+ * without locks. The published records must not
+ * change while other threads may read them.
  */
-void st_insert( char * name, int lineno, int loc, int decl, int type, char *scope );
+
+/* a symbol record; its fields are read
+ * through the functions below
+ */
+typedef struct BucketListRec * Symbol;
+
+/* the bindings st_lookup can select: the
+ * innermost visible one, the one declared in the
+ * current scope, or the global one
+ */
+#define ST_VISIBLE 0
+#define ST_LOCAL 1
+#define ST_GLOBAL 2
+
+/* Procedure st_enterScope opens a scope inside
+ * the current one; its symbols are listed under
+ * function name, or under the function of the
+ * enclosing scope if name is NULL
+ */
+void st_enterScope( char * name );
+
+/* Procedure st_exitScope closes the current
+ * scope, uncovering the bindings its symbols hid
+ */
+void st_exitScope(void);
+
+/* Function st_declare declares name in the
+ * current scope, or adds lineno to its record
+ * if it is already declared there, and returns
+ * the record
+ */
+Symbol st_declare( char * name, int lineno, int loc, int decl, int type );
+
+/* Function st_find returns the binding of name
+ * that where selects, or NULL if there is none;
+ * it is the only lookup that hashes the name
+ */
+Symbol st_find ( char * name, int where );
+
+/* Function st_select returns the binding that
+ * where selects among the binding s, which must
+ * be visible, and those it shadows, or NULL
+ */
+Symbol st_select ( Symbol s, int where );
+
+/* Procedure st_addLine adds a line number
+ * to the record of symbol s
+ */
+void st_addLine ( Symbol s, int lineno );
+
+/* Functions st_memloc, st_decl and st_type return
+ * the memory location, kind of declaration and
+ * type of symbol s, or -1 if s is NULL;
+ * st_setMemloc moves s to location loc
+ */
+int st_memloc ( Symbol s );
+void st_setMemloc ( Symbol s, int loc );
+int st_decl ( Symbol s );
+int st_type ( Symbol s );
+
+/* Functions st_name and st_scope return the name
+ * of symbol s and the function it is listed under
+ */
+char * st_name ( Symbol s );
+char * st_scope ( Symbol s );
+
+/* Function st_lines returns the line numbers of
+ * symbol s, encoded as its listing stores them:
+ * the difference of each from the one before,
+ * zigzag encoded, as a varint of 7 bits per
+ * byte. *n is set to the number of bytes.
+ */
+const unsigned char * st_lines ( Symbol s, int * n );
+
+/* Procedure st_addUse adds the line of a use of
+ * symbol s that the listing does not show, such
+ * as a read or a call; it does nothing unless
+ * st_recordUses(TRUE) has been called, and
+ * st_addUseOf then looks name up for it. st_uses
+ * returns them encoded as st_lines does.
+ */
+void st_addUse ( Symbol s, int lineno );
+void st_addUseOf ( char * name, int lineno );
+void st_recordUses ( int on );
+const unsigned char * st_uses ( Symbol s, int * n );
+
+/* Functions st_first and st_next return the
+ * symbols in the order they were inserted;
+ * they return NULL after the last one
+ */
+Symbol st_first ( void );
+Symbol st_next ( Symbol s );
 
 /* Function st_lookup returns the memory 
- * location of a variable or -1 if not found
+ * location of the binding of name that where
+ * selects, or -1 if not found; it is
+ * st_memloc(st_find(name, where))
+ */
+int st_lookup ( char * name, int where );
+
+/* Procedure st_publish freezes the global scope
+ * of this thread's table and publishes it to the
+ * threads with tables of their own. No scope but
+ * the global one may be open. Symbols declared
+ * later are not seen by the other threads.
+ */
+void st_publish(void);
+
+/* Procedure st_unpublish withdraws the published
+ * global scope; no other thread may be reading it
+ */
+void st_unpublish(void);
+
+/* Procedure st_beginThread gives the calling
+ * thread an empty table of its own, whose global
+ * scope is the published one; st_endThread frees
+ * it. Every function of this interface works on
+ * the table of the calling thread.
+ */
+void st_beginThread(void);
+void st_endThread(void);
+
+/* the symbols of a unit of the analysis and the
+ * lines it added to the symbols of other units
  */
-int st_lookup ( char * name, char * scope );
+typedef struct StUnitRec * StUnit;
 
-int st_lookup_decl ( char * name, char * scope );
+/* Procedure st_beginUnit starts unit number unit
+ * of an analysis split into units, such as the
+ * top-level declarations of a program. Until
+ * st_endUnit, the symbols declared belong to the
+ * unit, lines added to symbols of other units are
+ * kept aside, and the published globals of later
+ * units are not seen. A unit is analyzed by one
+ * thread at a time and only changes its own
+ * symbols, so units can be analyzed at once.
+ */
+void st_beginUnit ( int unit );
+
+/* Function st_endUnit ends the unit begun by
+ * st_beginUnit and takes its symbols and the
+ * lines kept aside off the table
+ */
+StUnit st_endUnit ( void );
+
+/* Procedure st_addUnit appends the symbols of
+ * unit u to this thread's table as if they had
+ * just been inserted, adds the lines it kept
+ * aside, and frees u. Units added in the order
+ * of their numbers leave the table as if their
+ * analysis had not been split.
+ */
+void st_addUnit ( StUnit u );
+
+/* Procedure st_clear empties the symbol table;
+ * its records belong to the arena of the
+ * compilation and are released with it
+ */
+void st_clear(void);
+
+/* Function st_lookup_decl returns the kind of
+ * declaration of the binding of name that where
+ * selects, or -1 if not found
+ */
+int st_lookup_decl ( char * name, int where );
 
 char *convertTypeToMessage (int type);
 
@@ -35,4 +202,9 @@ void printSymTab(FILE * listing);
 
 void printErrors(FILE * listing);
 
+/* Procedure st_printStats prints the size, load,
+ * scope and probe statistics of the table
+ */
+void st_printStats(FILE * f);
+
 #endif
@@ -1,7 +1,7 @@
 bison -d cminus.y &&
 flex cminus.l &&
 gcc -c *.c &&
-gcc -o cminus *.o -ll &&
+gcc -o cminus *.o -ll -lpthread &&
 mkdir -p results &&
 ./cminus testfiles/mdc.c > results/mdc.txt &&
 ./cminus testfiles/sort.c > results/sort.txt &&
@@ -0,0 +1,15 @@
+/* com --hash-cons, g[0] + 1 e calculado de novo depois de p[0] = 5,
+   pois p pode ser g */
+int g[10];
+
+void f(int p[]) {
+   int x;
+   x = g[0] + 1;
+   p[0] = 5;
+   x = g[0] + 1;
+   output(x);
+}
+
+void main(void){
+   f(g);
+}
@@ -0,0 +1,97 @@
+/****************************************************/
+/* File: tokbuf.c                                   */
+/* Token buffer implementation for the CMINUS       */
+/* compiler                                         */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include "util.h"
+#include "scan.h"
+#include "intern.h"
+#include "tokbuf.h"
+
+/* Procedure growBuffer doubles the capacity
+ * of every array of the buffer
+ */
+static int growBuffer(TokenBuffer * tb)
+{ int cap = tb->capacity ? tb->capacity * 2 : 1024;
+  TokenType * kind = realloc(tb->kind, cap * sizeof(TokenType));
+  int * pos = realloc(tb->pos, cap * sizeof(int));
+  int * len = realloc(tb->len, cap * sizeof(int));
+  int * line = realloc(tb->line, cap * sizeof(int));
+  char ** name = realloc(tb->name, cap * sizeof(char *));
+  if (kind) tb->kind = kind;
+  if (pos) tb->pos = pos;
+  if (len) tb->len = len;
+  if (line) tb->line = line;
+  if (name) tb->name = name;
+  if (!kind || !pos || !len || !line || !name)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    return FALSE;
+  }
+  tb->capacity = cap;
+  return TRUE;
+}
+
+/* Function tokenizeSource scans the whole source
+ * file with getToken and returns the buffer
+ */
+TokenBuffer * tokenizeSource(void)
+{ TokenBuffer * tb = (TokenBuffer *) calloc(1, sizeof(TokenBuffer));
+  int savedTrace = TraceScan;
+  TokenType tok;
+  if (tb == NULL)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    return NULL;
+  }
+  TraceScan = FALSE; /* tokens are echoed as they are replayed */
+  do
+  { int i = tb->count;
+    if (i == tb->capacity && !growBuffer(tb)) break;
+    tok = getToken();
+    tb->kind[i] = tok;
+    tb->pos[i] = (int) tokenPos;
+    tb->len[i] = tokenLen;
+    tb->line[i] = lineno;
+    tb->name[i] = tok == ID ? identifierName() : NULL;
+    tb->count++;
+  } while (tok != ENDFILE);
+  TraceScan = savedTrace;
+  return tb;
+}
+
+/* Function replayToken returns the next token of
+ * the buffer, restoring the scanner state (spans
+ * and lineno) as getToken would have left it
+ */
+TokenType replayToken(TokenBuffer * tb)
+{ int i = tb->next;
+  if (i >= tb->count) return ENDFILE;
+  if (tb->kind[i] != ENDFILE) tb->next++;
+  tokenPos = tb->pos[i];
+  tokenLen = tb->len[i];
+  if (tb->kind[i] == ID)
+  { idPos = tokenPos;
+    idLen = tokenLen;
+    idName = tb->name[i];
+  }
+  lineno = tb->line[i];
+  if (TraceScan) {
+    fprintf(listing,"\t%d: ",lineno);
+    printToken(tb->kind[i],tokenText());
+  }
+  return tb->kind[i];
+}
+
+/* Procedure freeTokenBuffer releases the buffer */
+void freeTokenBuffer(TokenBuffer * tb)
+{ if (tb == NULL) return;
+  free(tb->kind);
+  free(tb->pos);
+  free(tb->len);
+  free(tb->line);
+  free(tb->name);
+  free(tb);
+}
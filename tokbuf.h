@@ -0,0 +1,41 @@
+/****************************************************/
+/* File: tokbuf.h                                   */
+/* Token buffer interface for the CMINUS compiler   */
+/* The whole source file is scanned once into a     */
+/* struct-of-arrays buffer that the parser replays  */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _TOKBUF_H_
+#define _TOKBUF_H_
+
+/* Token i of the buffer is described by the i-th
+ * entry of each array; the last token is ENDFILE
+ */
+typedef struct
+   { int count;        /* number of tokens */
+     int capacity;     /* allocated entries per array */
+     TokenType * kind; /* token type */
+     int * pos;        /* offset of the lexeme in sourceText */
+     int * len;        /* length of the lexeme */
+     int * line;       /* lineno when the token was scanned */
+     char ** name;     /* interned identifier, or NULL if not an ID */
+     int next;         /* index of the next token to replay */
+   } TokenBuffer;
+
+/* Function tokenizeSource scans the whole source
+ * file with getToken and returns the buffer
+ */
+TokenBuffer * tokenizeSource(void);
+
+/* Function replayToken returns the next token of
+ * the buffer, restoring the scanner state (spans
+ * and lineno) as getToken would have left it
+ */
+TokenType replayToken(TokenBuffer * tb);
+
+/* Procedure freeTokenBuffer releases the buffer */
+void freeTokenBuffer(TokenBuffer * tb);
+
+#endif
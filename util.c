@@ -8,6 +8,7 @@
 
 #include "globals.h"
 #include "util.h"
+#include "arena.h"
 
 /* Procedure printToken prints a token
  * and its lexeme to the listing file
@@ -63,8 +64,9 @@ void printToken( TokenType token, const char* tokenString )
  */
 TreeNode * newStmtNode(StmtKind kind)
 {
-  TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
+  TreeNode * t = (TreeNode *) arenaAlloc(currentArena, sizeof(TreeNode));
   int i;
+  currentArena->nodes++;
   if (t==NULL)
     fprintf(listing,"Out of memory error at line %d\n",lineno);
   else {
@@ -73,6 +75,9 @@ TreeNode * newStmtNode(StmtKind kind)
     t->nodekind = StmtK;
     t->kind.stmt = kind;
     t->lineno = lineno;
+    t->decl = 0;
+    t->type = Void;
+    t->consed = FALSE;
   }
   return t;
 }
@@ -86,8 +91,9 @@ TreeNode * newStmtNode(StmtKind kind)
  * node for syntax tree construction
  */
 TreeNode * newExpNode(ExpKind kind)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
+{ TreeNode * t = (TreeNode *) arenaAlloc(currentArena, sizeof(TreeNode));
   int i;
+  currentArena->nodes++;
   if (t==NULL)
     fprintf(listing,"Out of memory error at line %d\n",lineno);
   else {
@@ -96,20 +102,22 @@ TreeNode * newExpNode(ExpKind kind)
     t->nodekind = ExpK;
     t->kind.exp = kind;
     t->lineno = lineno;
+    t->decl = 0;
     t->type = Void;
+    t->consed = FALSE;
   }
   return t;
 }
 
 /* Function copyString allocates and makes a new
- * copy of an existing string
+ * copy of an existing string in the current arena
  */
 char * copyString(char * s)
 { int n;
   char * t;
   if (s==NULL) return NULL;
   n = strlen(s)+1;
-  t = malloc(n);
+  t = arenaAlloc(currentArena, n);
   if (t==NULL)
     fprintf(listing,"Out of memory error at line %d\n",lineno);
   else strcpy(t,s);
@@ -119,7 +127,7 @@ char * copyString(char * s)
 /* Variable indentno is used by printTree to
  * store current number of spaces to indent
  */
-static int indentno = 0;
+static THREAD_LOCAL int indentno = 0;
 
 /* macros to increase/decrease indentation */
 #define INDENT indentno+=2
@@ -201,3 +209,41 @@ void printTree( TreeNode * tree )
   }
   UNINDENT;
 }
+
+/* Procedure saveGlobals copies the globals of
+ * the calling thread to g
+ */
+void saveGlobals(Globals * g)
+{ g->source = source;
+  g->sourceText = sourceText;
+  g->sourceLen = sourceLen;
+  g->listing = listing;
+  g->code = code;
+  g->echoSource = EchoSource;
+  g->traceScan = TraceScan;
+  g->traceParse = TraceParse;
+  g->traceAnalyze = TraceAnalyze;
+  g->traceCode = TraceCode;
+  g->flexScan = FlexScan;
+  g->hashCons = HashCons;
+  g->error = Error;
+}
+
+/* Procedure loadGlobals sets the globals of the
+ * calling thread to those saved in g
+ */
+void loadGlobals(const Globals * g)
+{ source = g->source;
+  sourceText = g->sourceText;
+  sourceLen = g->sourceLen;
+  listing = g->listing;
+  code = g->code;
+  EchoSource = g->echoSource;
+  TraceScan = g->traceScan;
+  TraceParse = g->traceParse;
+  TraceAnalyze = g->traceAnalyze;
+  TraceCode = g->traceCode;
+  FlexScan = g->flexScan;
+  HashCons = g->hashCons;
+  Error = g->error;
+}
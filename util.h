@@ -33,4 +33,27 @@ char * copyString( char * );
  */
 void printTree( TreeNode * );
 
+/* Globals holds a copy of the per-thread
+ * globals of globals.h, but for lineno
+ */
+typedef struct
+   { FILE * source;
+     const char * sourceText;
+     long sourceLen;
+     FILE * listing;
+     FILE * code;
+     int echoSource, traceScan, traceParse, traceAnalyze;
+     int traceCode, flexScan, hashCons, error;
+   } Globals;
+
+/* Procedure saveGlobals copies the globals of
+ * the calling thread to g
+ */
+void saveGlobals(Globals * g);
+
+/* Procedure loadGlobals sets the globals of the
+ * calling thread to those saved in g
+ */
+void loadGlobals(const Globals * g);
+
 #endif
@@ -0,0 +1,687 @@
+/****************************************************/
+/* File: watch.c                                    */
+/* Watch mode of the CMINUS compiler: recompiles    */
+/* the functions of the sources that change         */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "arena.h"
+#include "intern.h"
+#include "scan.h"
+#include "tokbuf.h"
+#include "parse.h"
+#include "analyze.h"
+#include "symtab.h"
+#include "cgen.h"
+#include "watch.h"
+
+/* the bytes of replaced trees the arena of a file
+ * may hold, beyond those of its live trees, before
+ * the file is parsed again as a whole
+ */
+#define SLACK (1L << 20)
+
+/* a top-level declaration of a watched file */
+typedef struct
+   { long start;        /* its bytes in the source */
+     long end;
+     int line;          /* source line of its first byte */
+     unsigned long long hash; /* of its bytes */
+     TreeNode * t;
+     long bytes;        /* arena bytes its tree takes */
+     char ** uses;      /* the names in it, sorted */
+     int nuses;
+     Analysis kept;     /* what the analysis of its body found */
+     CodeUnit code;
+     int analyze;       /* TRUE if its body is analyzed again */
+     int written;       /* TRUE if its code is in the code last */
+     long out;          /* written, out bytes into it, placed */
+     long outSize;      /* after temps temps and labels labels */
+     int temps;
+     int labels;
+   } Decl;
+
+/* a source file of the watched directory, as it
+ * was last compiled without syntax errors
+ */
+typedef struct WatchedRec
+   { char * name;
+     char * path;
+     char * codefile;
+     char * text;
+     long len;
+     Decl * decls;
+     int count;
+     Arena trees;  /* the trees of its declarations */
+     char * output; /* the code file last written */
+     int failed;   /* TRUE if it had syntax errors since */
+     struct WatchedRec * next;
+   } Watched;
+
+static Watched * watched = NULL;
+
+/* the names and paths of the watched files, which
+ * are kept as long as the directory is watched
+ */
+static Arena paths;
+
+/* the names collectUses has found */
+static char ** names;
+static int nameCount;
+static int nameSize;
+
+static void * allocate(size_t n)
+{ void * p = malloc(n);
+  if (p == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  return p;
+}
+
+/* Function readSource returns the contents of
+ * file path, NUL terminated, and its length in
+ * *len, or NULL if it cannot be read
+ */
+static char * readSource(char * path, long * len)
+{ struct stat st;
+  char * text;
+  long n = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) != 0)
+  { close(fd);
+    return NULL;
+  }
+  text = (char *) allocate(st.st_size + 1);
+  while (n < st.st_size)
+  { ssize_t r = read(fd, text + n, st.st_size - n);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) break;
+    n += r;
+  }
+  close(fd);
+  text[n] = '\0';
+  *len = n;
+  return text;
+}
+
+/* Function commonPrefix returns how many bytes
+ * the n bytes at a and b begin with in common
+ */
+static long commonPrefix(const char * a, const char * b, long n)
+{ long i = 0;
+  while (i + 4096 <= n && memcmp(a + i, b + i, 4096) == 0) i += 4096;
+  while (i < n && a[i] == b[i]) i++;
+  return i;
+}
+
+/* Function commonSuffix returns how many bytes
+ * the n bytes before a and b end with in common
+ */
+static long commonSuffix(const char * a, const char * b, long n)
+{ long i = 0;
+  while (i + 4096 <= n && memcmp(a - i - 4096, b - i - 4096, 4096) == 0) i += 4096;
+  while (i < n && a[-i - 1] == b[-i - 1]) i++;
+  return i;
+}
+
+static int countLines(const char * p, long n)
+{ int lines = 0;
+  const char * end = p + n;
+  while ((p = memchr(p, '\n', end - p)) != NULL)
+  { lines++;
+    p++;
+  }
+  return lines;
+}
+
+static Decl * addDecl(Decl * d, int n, int * size)
+{ if (n == *size)
+  { *size = *size ? 2 * *size : 64;
+    d = (Decl *) realloc(d, *size * sizeof(Decl));
+    if (d == NULL)
+    { fprintf(listing,"Out of memory error\n");
+      exit(1);
+    }
+  }
+  memset(&d[n], 0, sizeof(Decl));
+  return d;
+}
+
+/* Function splitSource divides the source into
+ * its top-level declarations, each with the blanks
+ * and comments before it, into *decls; returns
+ * their number, or -1 if a brace does not match.
+ * Only the bytes that differ from the text f was
+ * last compiled from are scanned: the declarations
+ * of f before them, *same of them, and after them,
+ * *tail of them, are found where they were, moved
+ * by the bytes and lines added or removed.
+ */
+static int splitSource(Watched * f, Decl ** decls, int * same, int * tail)
+{ Decl * d = NULL;
+  Decl * o = f->decls;
+  long pos = 0, prefix = 0, suffix = 0, delta = 0;
+  int line = 1, n = 0, size = 0, k = f->count;
+  *same = *tail = 0;
+  if (f->text != NULL)
+  { long m = sourceLen < f->len ? sourceLen : f->len;
+    prefix = commonPrefix(sourceText, f->text, m);
+    suffix = commonSuffix(sourceText + sourceLen, f->text + f->len, m - prefix);
+    delta = sourceLen - f->len;
+    /* a declaration ends where its ';' or '}' is, so one
+     * that ends before the first change is found again */
+    while (n < f->count && o[n].end < prefix)
+    { d = addDecl(d, n, &size);
+      d[n].start = o[n].start;
+      d[n].end = o[n].end;
+      d[n].line = o[n].line;
+      d[n].hash = o[n].hash;
+      n++;
+    }
+    if (n > 0)
+    { pos = o[n - 1].end;
+      line = o[n - 1].line + countLines(sourceText + o[n - 1].start, pos - o[n - 1].start);
+    }
+    /* the first declaration that lies after the last change */
+    for (k = n; k < f->count && o[k].start < f->len - suffix; k++) ;
+    *same = n;
+  }
+  while (pos < sourceLen)
+  { int first = line, blank;
+    long end;
+    while (k < f->count && o[k].start + delta < pos) k++;
+    if (k < f->count && o[k].start + delta == pos)
+    { /* the rest is scanned as it was */
+      int lines = line - o[k].line;
+      *tail = f->count - k;
+      for ( ; k < f->count; k++, n++)
+      { d = addDecl(d, n, &size);
+        d[n].start = o[k].start + delta;
+        d[n].end = o[k].end + delta;
+        d[n].line = o[k].line + lines;
+        d[n].hash = o[k].hash;
+      }
+      break;
+    }
+    end = declEnd(pos, &line, &blank);
+    if (end < 0)
+    { free(d);
+      return -1;
+    }
+    if (blank) break;
+    d = addDecl(d, n, &size);
+    d[n].start = pos;
+    d[n].end = end;
+    d[n].line = first;
+    d[n].hash = textHash(sourceText + pos, end - pos);
+    n++;
+    pos = end;
+  }
+  *decls = d;
+  return n;
+}
+
+/* Function sameText tells whether declaration n
+ * of the source has the text of declaration o of
+ * the old source text
+ */
+static int sameText(Decl * o, const char * text, Decl * n)
+{ return o->hash == n->hash && o->end - o->start == n->end - n->start &&
+         memcmp(text + o->start, sourceText + n->start, n->end - n->start) == 0;
+}
+
+static int hasName(TreeNode * t)
+{ if (t->nodekind == ExpK) return t->kind.exp == IdK;
+  switch (t->kind.stmt)
+  { case AssignK:
+    case ActivK:
+    case VarDeclK:
+    case FuncDeclK:
+    case ArrDeclK:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+static void addNames(TreeNode * t)
+{ int i;
+  while (t != NULL)
+  { if (hasName(t))
+    { if (nameCount == nameSize)
+      { nameSize = nameSize ? 2 * nameSize : 256;
+        names = (char **) realloc(names, nameSize * sizeof(char *));
+        if (names == NULL)
+        { fprintf(listing,"Out of memory error\n");
+          exit(1);
+        }
+      }
+      names[nameCount++] = t->attr.name;
+    }
+    for (i = 0; i < MAXCHILDREN; i++) addNames(t->child[i]);
+    t = t->sibling;
+  }
+}
+
+/* names are interned, so they are compared by address */
+static int compareNames(const void * a, const void * b)
+{ uintptr_t x = (uintptr_t) *(char * const *) a;
+  uintptr_t y = (uintptr_t) *(char * const *) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Function sortNames sorts the n names at p and
+ * drops the repeated ones; returns how many are
+ * left
+ */
+static int sortNames(char ** p, int n)
+{ int i, k = 0;
+  qsort(p, n, sizeof(char *), compareNames);
+  for (i = 0; i < n; i++)
+    if (k == 0 || p[i] != p[k - 1]) p[k++] = p[i];
+  return k;
+}
+
+/* Procedure collectUses gives d the names that
+ * its tree declares or refers to
+ */
+static void collectUses(Decl * d)
+{ nameCount = 0;
+  addNames(d->t);
+  nameCount = sortNames(names, nameCount);
+  d->uses = (char **) allocate((nameCount + 1) * sizeof(char *));
+  memcpy(d->uses, names, nameCount * sizeof(char *));
+  d->nuses = nameCount;
+}
+
+/* Function usesAny tells whether d refers to one
+ * of the n sorted names at p
+ */
+static int usesAny(Decl * d, char ** p, int n)
+{ int i;
+  for (i = 0; i < n; i++)
+    if (bsearch(&p[i], d->uses, d->nuses, sizeof(char *), compareNames) != NULL)
+      return TRUE;
+  return FALSE;
+}
+
+/* Function declName returns the name declared by
+ * the top-level declaration d
+ */
+static char * declName(Decl * d)
+{ TreeNode * t = d->t->child[0];
+  return t != NULL ? t->attr.name : NULL;
+}
+
+/* Procedure shiftLines moves the nodes of tree t
+ * by delta lines
+ */
+static void shiftLines(TreeNode * t, int delta)
+{ int i;
+  while (t != NULL)
+  { t->lineno += delta;
+    for (i = 0; i < MAXCHILDREN; i++) shiftLines(t->child[i], delta);
+    t = t->sibling;
+  }
+}
+
+static void freeDecl(Decl * d)
+{ free(d->uses);
+  analyzeFree(d->kept);
+  free(d->code.text);
+}
+
+/* Procedure take gives the declaration d of the
+ * source the tree, analysis and code of the same
+ * declaration o of the old source. If it moved to
+ * other lines, so do the lines of its tree, and
+ * its body is analyzed again if its errors give
+ * the old ones.
+ */
+static void take(Decl * d, Decl * o)
+{ d->t = o->t;
+  d->bytes = o->bytes;
+  d->uses = o->uses;
+  d->nuses = o->nuses;
+  d->kept = o->kept;
+  d->code = o->code;
+  d->written = o->written;
+  d->out = o->out;
+  d->outSize = o->outSize;
+  d->temps = o->temps;
+  d->labels = o->labels;
+  if (d->line != o->line)
+  { shiftLines(d->t, d->line - o->line);
+    d->analyze = d->kept != NULL && analyzeErrors(d->kept) > 0;
+  }
+}
+
+/* Procedure analyze analyzes the n declarations
+ * of d as buildSymtab and typeCheck would, but for
+ * the bodies not marked to be analyzed again,
+ * whose earlier analysis is reused; returns the
+ * number of bodies analyzed
+ */
+static int analyze(Decl * d, int n)
+{ Analysis * a = (Analysis *) allocate((n + 1) * sizeof(Analysis));
+  Arena symbols;
+  Arena * trees = currentArena;
+  int i, analyzed = 0;
+  memset(&symbols, 0, sizeof(Arena));
+  currentArena = &symbols;
+  startAnalysis();
+  for (i = 0; i < n; i++) a[i] = analyzeHead(d[i].t, i);
+  st_publish();
+  st_beginThread();
+  for (i = 0; i < n; i++)
+    if (d[i].analyze)
+    { analyzeBody(a[i]);
+      analyzed++;
+    }
+    else analyzeReuse(a[i], d[i].kept);
+  st_endThread();
+  st_unpublish();
+  for (i = 0; i < n; i++)
+  { if (d[i].analyze)
+    { analyzeFree(d[i].kept);
+      d[i].kept = analyzeKeep(a[i]);
+    }
+    analyzeMerge(a[i]);
+  }
+  typeCheck(NULL);
+  /* the symbols are not needed once the program is checked */
+  st_clear();
+  arenaRelease(&symbols);
+  currentArena = trees;
+  free(a);
+  return analyzed;
+}
+
+/* Procedure writeCode writes the code of the n
+ * declarations of d to the code file of f. The
+ * code of a declaration placed after as many temps
+ * and labels as in the code last written is copied
+ * from it, rather than placed again.
+ */
+static void writeCode(Watched * f, Decl * d, int n)
+{ char * text = NULL;
+  size_t size = 0;
+  FILE * file;
+  long at, from = 0, copied = 0;
+  int i, temps = 0, labels = 0;
+  code = open_memstream(&text, &size);
+  if (code == NULL)
+  { fprintf(listing,"Out of memory error\n");
+    exit(1);
+  }
+  codeGenStart(f->codefile);
+  at = ftell(code);
+  for (i = 0; i < n; i++)
+  { long placed;
+    if (d[i].written && d[i].temps == temps && d[i].labels == labels)
+    { /* copied with the declarations copied just before it, if it followed them */
+      if (copied > 0 && d[i].out != from + copied)
+      { fwrite(f->output + from, 1, copied, code);
+        copied = 0;
+      }
+      if (copied == 0) from = d[i].out;
+      copied += d[i].outSize;
+      codeGenSkip(&d[i].code);
+      placed = d[i].outSize;
+    }
+    else
+    { if (copied > 0) fwrite(f->output + from, 1, copied, code);
+      copied = 0;
+      placed = (long) codeGenCopy(&d[i].code);
+    }
+    d[i].written = TRUE;
+    d[i].out = at;
+    d[i].outSize = placed;
+    d[i].temps = temps;
+    d[i].labels = labels;
+    at += placed;
+    temps += d[i].code.temps;
+    labels += d[i].code.labels;
+  }
+  if (copied > 0) fwrite(f->output + from, 1, copied, code);
+  codeGenEnd();
+  fclose(code);
+  free(f->output);
+  f->output = text;
+  file = fopen(f->codefile, "w");
+  if (file == NULL)
+  { fprintf(listing,"Unable to open %s\n",f->codefile);
+    return;
+  }
+  fwrite(text, 1, size, file);
+  fclose(file);
+}
+
+/* Procedure compileFile compiles f again. The
+ * declarations before and after those whose text
+ * changed keep their trees and code; the changed
+ * ones are parsed and generated again. These and
+ * the functions that refer to a name they declare
+ * or declared are analyzed again. The file is
+ * parsed as a whole the first time, and when the
+ * trees it replaced take too much memory.
+ */
+static void compileFile(Watched * f)
+{ struct timespec t0, t1;
+  Decl * d = NULL;
+  Arena fresh;
+  Arena * trees;
+  char ** dirty;
+  char * text;
+  long len, live = 0;
+  int n, i, p = 0, s = 0, ndirty = 0, analyzed = 0, ok = TRUE, full;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  text = readSource(f->path, &len);
+  if (text == NULL)
+  { fprintf(stderr,"Unable to read %s\n",f->path);
+    return;
+  }
+  /* a file written again without a change */
+  if (f->text != NULL && ! f->failed && len == f->len && memcmp(text, f->text, len) == 0)
+  { free(text);
+    return;
+  }
+  source = NULL;
+  sourceText = text;
+  sourceLen = len;
+  Error = 0;
+  n = splitSource(f, &d, &p, &s);
+  for (i = 0; i < f->count; i++) live += f->decls[i].bytes;
+  full = f->text == NULL || f->trees.bytes > 2 * live + SLACK;
+  if (full) p = s = 0;
+  else
+  { while (p < n && p < f->count && sameText(&f->decls[p], f->text, &d[p])) p++;
+    while (s < n - p && s < f->count - p &&
+           sameText(&f->decls[f->count - 1 - s], f->text, &d[n - 1 - s]))
+      s++;
+  }
+  memset(&fresh, 0, sizeof(Arena));
+  trees = full ? &fresh : &f->trees;
+  currentArena = trees;
+  if (n <= 0) ok = FALSE;
+  for (i = p; i < n - s && ok; i++)
+  { long before = trees->bytes;
+    d[i].t = parseRange(d[i].start, d[i].end, d[i].line, &ok);
+    d[i].bytes = trees->bytes - before;
+    d[i].analyze = TRUE;
+    if (d[i].t == NULL || d[i].t->sibling != NULL) ok = FALSE;
+    else collectUses(&d[i]);
+  }
+  if (! ok)
+  { /* parsed again as a whole, so that the syntax errors are reported as usual */
+    for (i = p; i < n - s; i++) free(d[i].uses);
+    free(d);
+    arenaRelease(&fresh);
+    currentArena = &fresh;
+    resetScanner();
+    lineno = 0;
+    parse();
+    arenaRelease(&fresh);
+    currentArena = &f->trees;
+    remove(f->codefile);
+    f->failed = TRUE;
+    free(text);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fprintf(listing,"%s: %d errors, %.3f ms\n",f->path,Error,
+            (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    return;
+  }
+  /* the names declared by the changed declarations, before and after */
+  dirty = (char **) allocate((f->count - p - s + n - p - s + 1) * sizeof(char *));
+  if (full)
+  { for (i = 0; i < f->count; i++) freeDecl(&f->decls[i]);
+    arenaRelease(&f->trees);
+    arenaJoin(&f->trees, &fresh);
+    currentArena = &f->trees;
+  }
+  else
+  { for (i = 0; i < p; i++) take(&d[i], &f->decls[i]);
+    for (i = 0; i < s; i++) take(&d[n - s + i], &f->decls[f->count - s + i]);
+    for (i = p; i < f->count - s; i++)
+    { if (declName(&f->decls[i]) != NULL) dirty[ndirty++] = declName(&f->decls[i]);
+      freeDecl(&f->decls[i]);
+    }
+    for (i = p; i < n - s; i++)
+      if (declName(&d[i]) != NULL) dirty[ndirty++] = declName(&d[i]);
+    ndirty = sortNames(dirty, ndirty);
+    for (i = 0; i < n; i++)
+      if (! d[i].analyze) d[i].analyze = usesAny(&d[i], dirty, ndirty);
+  }
+  free(dirty);
+  analyzed = analyze(d, n);
+  /* as from the command line, no code is generated after an error,
+   * so declarations may be left without it until the errors are gone */
+  if (! Error)
+  { for (i = 0; i < n; i++)
+      if (d[i].code.text == NULL) codeGenUnit(d[i].t, &d[i].code);
+    codeGenRelease();
+    writeCode(f, d, n);
+  }
+  else remove(f->codefile);
+  free(f->decls);
+  f->decls = d;
+  f->count = n;
+  free(f->text);
+  f->text = text;
+  f->len = len;
+  f->failed = FALSE;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  fprintf(listing,"%s: %d of %d declarations parsed, %d analyzed, %d errors, %.3f ms\n",
+          f->path,n - p - s,n,analyzed,Error,
+          (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+}
+
+static int isSource(const char * name)
+{ int len = (int) strlen(name);
+  return len >= 3 && strcmp(name + len - 2, ".c") == 0;
+}
+
+/* Function findWatched returns the watched file
+ * name of directory dir, which it adds if need be
+ */
+static Watched * findWatched(char * dir, char * name)
+{ Watched * f;
+  Arena * saved = currentArena;
+  int len = (int) strcspn(name, ".");
+  for (f = watched; f != NULL; f = f->next)
+    if (strcmp(f->name, name) == 0) return f;
+  f = (Watched *) allocate(sizeof(Watched));
+  memset(f, 0, sizeof(Watched));
+  currentArena = &paths;
+  f->name = copyString(name);
+  f->path = (char *) arenaAlloc(&paths, strlen(dir) + strlen(name) + 2);
+  sprintf(f->path, "%s/%s", dir, name);
+  f->codefile = (char *) arenaAlloc(&paths, strlen(dir) + len + 5);
+  sprintf(f->codefile, "%s/%.*s.tm", dir, len, name);
+  currentArena = saved;
+  f->next = watched;
+  watched = f;
+  return f;
+}
+
+static int compareFiles(const void * a, const void * b)
+{ return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Procedure compileAll compiles the .c files of
+ * dir in the order of their names
+ */
+static void compileAll(char * dir)
+{ DIR * d = opendir(dir);
+  struct dirent * e;
+  Arena listed;
+  Arena * saved = currentArena;
+  char ** files = NULL;
+  int n = 0, size = 0, i;
+  if (d == NULL) return;
+  memset(&listed, 0, sizeof(Arena));
+  currentArena = &listed;
+  while ((e = readdir(d)) != NULL)
+  { if (! isSource(e->d_name)) continue;
+    if (n == size)
+    { size = size ? 2 * size : 64;
+      files = (char **) realloc(files, size * sizeof(char *));
+      if (files == NULL)
+      { fprintf(listing,"Out of memory error\n");
+        exit(1);
+      }
+    }
+    files[n++] = copyString(e->d_name);
+  }
+  closedir(d);
+  currentArena = saved;
+  qsort(files, n, sizeof(char *), compareFiles);
+  for (i = 0; i < n; i++) compileFile(findWatched(dir, files[i]));
+  arenaRelease(&listed);
+  free(files);
+  fflush(listing);
+}
+
+int watchDirectory(char * dir)
+{ char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  int fd = inotify_init1(IN_CLOEXEC);
+  /* the symbol table is not listed */
+  EchoSource = TraceScan = TraceParse = TraceAnalyze = TraceCode = FALSE;
+  /* watched before the first compilation, so that no write is missed;
+   * editors that save to another file rename it over the source */
+  if (fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  { fprintf(stderr,"Unable to watch %s\n",dir);
+    return 1;
+  }
+  initNames();
+  compileAll(dir);
+  for (;;)
+  { ssize_t n = read(fd, events, sizeof(events));
+    char * p;
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    for (p = events; p < events + n; )
+    { struct inotify_event * e = (struct inotify_event *) p;
+      if (e->len > 0 && ! (e->mask & IN_ISDIR) && isSource(e->name))
+        compileFile(findWatched(dir, e->name));
+      p += sizeof(struct inotify_event) + e->len;
+    }
+    fflush(listing);
+  }
+  fprintf(stderr,"Unable to watch %s\n",dir);
+  close(fd);
+  return 1;
+}
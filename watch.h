@@ -0,0 +1,26 @@
+/****************************************************/
+/* File: watch.h                                    */
+/* Watch mode of the CMINUS compiler: recompiles    */
+/* the functions of the sources that change         */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+/* Function watchDirectory compiles the .c files of
+ * directory dir, then waits for them to be written
+ * and compiles them again, as the command line
+ * compiler would but for the symbol table, which
+ * is not listed. Only the top-level declarations
+ * whose text changed are parsed and have their
+ * code generated again; they are analyzed again
+ * with the functions that refer to them. The
+ * errors of each compilation and what it did are
+ * printed to the listing file. Returns only if dir
+ * cannot be watched.
+ */
+int watchDirectory(char * dir);
+
+#endif
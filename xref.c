@@ -0,0 +1,412 @@
+/****************************************************/
+/* File: xref.c                                     */
+/* Cross-reference index for the CMINUS compiler    */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include "globals.h"
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "symtab.h"
+#include "xref.h"
+
+/* The index is one file, in the byte order of
+ * the host, laid out as
+ *
+ *   XrefHeader
+ *   uint32_t   files[header.files]       offsets of file names
+ *   XrefSymbol symbols[header.symbols]   sorted by name, file, line
+ *   char       strings[header.strings]   NUL terminated names
+ *   uint8_t    lines[header.lines]       reference lines
+ *
+ * The lines of a symbol, its declaration,
+ * assignments and uses in increasing order, are
+ * encoded as in the symbol table (see st_lines).
+ */
+#define XREF_MAGIC "CMXREF\0"
+#define XREF_VERSION 1
+
+typedef struct
+   { char magic[8];
+     uint32_t version;
+     uint32_t files;
+     uint32_t symbols;
+     uint32_t strings;
+     uint32_t lines;
+     uint32_t reserved;
+   } XrefHeader;
+
+typedef struct
+   { uint32_t name;      /* offset in strings */
+     uint32_t scope;     /* offset in strings */
+     uint32_t file;      /* index in files */
+     int32_t memloc;
+     int32_t line;       /* of the declaration */
+     uint32_t lines;     /* offset in lines */
+     uint32_t lineBytes;
+     uint8_t decl;
+     uint8_t type;
+     uint16_t reserved;
+   } XrefSymbol;
+
+/* a mapped index */
+typedef struct
+   { void * base;
+     size_t size;
+     XrefHeader * header;
+     uint32_t * files;
+     XrefSymbol * symbols;
+     const char * strings;
+     const unsigned char * lines;
+   } XrefIndex;
+
+/* Function mapIndex maps the index at path into
+ * x; returns FALSE if there is no valid index
+ */
+static int mapIndex(const char * path, XrefIndex * x)
+{ struct stat st;
+  size_t need;
+  int fd = open(path, O_RDONLY);
+  memset(x, 0, sizeof(XrefIndex));
+  if (fd < 0) return FALSE;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(XrefHeader))
+  { close(fd);
+    return FALSE;
+  }
+  x->size = (size_t) st.st_size;
+  x->base = mmap(NULL, x->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (x->base == MAP_FAILED)
+  { x->base = NULL;
+    return FALSE;
+  }
+  x->header = (XrefHeader *) x->base;
+  need = sizeof(XrefHeader) + x->header->files * sizeof(uint32_t) +
+         x->header->symbols * sizeof(XrefSymbol) +
+         x->header->strings + x->header->lines;
+  if (memcmp(x->header->magic, XREF_MAGIC, 8) != 0 ||
+      x->header->version != XREF_VERSION || need != x->size)
+  { munmap(x->base, x->size);
+    x->base = NULL;
+    return FALSE;
+  }
+  x->files = (uint32_t *) (x->header + 1);
+  x->symbols = (XrefSymbol *) (x->files + x->header->files);
+  x->strings = (const char *) (x->symbols + x->header->symbols);
+  x->lines = (const unsigned char *) (x->strings + x->header->strings);
+  return TRUE;
+}
+
+static void unmapIndex(XrefIndex * x)
+{ if (x->base != NULL) munmap(x->base, x->size);
+  x->base = NULL;
+}
+
+/* Function nextLine decodes the line at *pos of
+ * the encoded lines p that follows line prev
+ */
+static int nextLine(const unsigned char * p, int * pos, int prev)
+{ unsigned z = 0;
+  int shift = 0;
+  unsigned char c;
+  do
+  { c = p[(*pos)++];
+    z |= (unsigned) (c & 0x7F) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return prev + (int) ((z >> 1) ^ -(z & 1));
+}
+
+/* a symbol on its way into a new index */
+typedef struct
+   { const char * name;
+     const char * scope;
+     const char * file;
+     int memloc;
+     int decl;
+     int type;
+     int line;
+     const unsigned char * lines;
+     int lineBytes;
+     unsigned char * merged; /* lines, if malloc'd here */
+   } Entry;
+
+static int compareEntries(const void * a, const void * b)
+{ const Entry * e1 = (const Entry *) a;
+  const Entry * e2 = (const Entry *) b;
+  int c = strcmp(e1->name, e2->name);
+  if (c == 0) c = strcmp(e1->file, e2->file);
+  if (c == 0) c = e1->line - e2->line;
+  return c;
+}
+
+/* Procedure putLine appends line to the encoded
+ * lines p, which follow line prev
+ */
+static void putLine(unsigned char * p, int * pos, int prev, int line)
+{ int d = line - prev;
+  unsigned z = ((unsigned) d << 1) ^ (unsigned) (d >> 31);
+  while (z >= 0x80)
+  { p[(*pos)++] = (unsigned char) (z | 0x80);
+    z >>= 7;
+  }
+  p[(*pos)++] = (unsigned char) z;
+}
+
+/* Function mergeLines merges the listed lines
+ * of symbol s with its uses into e, in order
+ * and each once; returns FALSE if out of memory
+ */
+static int mergeLines(Symbol s, Entry * e)
+{ int n1, n2, p1 = 0, p2 = 0, pos = 0;
+  int l1 = 0, l2 = 0, last = 0;
+  const unsigned char * b1 = st_lines(s, &n1);
+  const unsigned char * b2 = st_uses(s, &n2);
+  e->merged = NULL;
+  e->lines = b1;
+  e->lineBytes = n1;
+  e->line = n1 > 0 ? nextLine(b1, &p1, 0) : 0;
+  if (n2 == 0) return TRUE;
+  /* no delta grows past five bytes */
+  e->merged = (unsigned char *) malloc(5 * (size_t) (n1 + n2));
+  if (e->merged == NULL) return FALSE;
+  p1 = 0;
+  if (p1 < n1) l1 = nextLine(b1, &p1, 0);
+  l2 = nextLine(b2, &p2, 0);
+  while (l1 != 0 || l2 != 0)
+  { int line;
+    if (l2 == 0 || (l1 != 0 && l1 <= l2)) line = l1;
+    else line = l2;
+    if (line != last) putLine(e->merged, &pos, last, line);
+    last = line;
+    if (line == l1) l1 = p1 < n1 ? nextLine(b1, &p1, l1) : 0;
+    if (line == l2) l2 = p2 < n2 ? nextLine(b2, &p2, l2) : 0;
+  }
+  e->lines = e->merged;
+  e->lineBytes = pos;
+  return TRUE;
+}
+
+/* the strings of a new index, each stored once:
+ * an open addressing table from their text to
+ * their offset and, for file names, their index
+ */
+typedef struct
+   { const char * s;
+     uint32_t offset;
+     int file;
+   } StringSlot;
+
+static StringSlot * stringTable;
+static int stringSlots;
+static uint32_t stringBytes;
+static int fileCount;
+
+static unsigned long long textHash(const char * s)
+{ unsigned long long h = 0xCBF29CE484222325ULL;
+  while (*s) h = (h ^ (unsigned char) *s++) * 0x100000001B3ULL;
+  return h;
+}
+
+/* Function stringSlot returns the slot of s,
+ * giving it an offset if it is new
+ */
+static StringSlot * stringSlot(const char * s)
+{ int i = (int) (textHash(s) & (stringSlots - 1));
+  while (stringTable[i].s != NULL && strcmp(stringTable[i].s, s) != 0)
+    i = (i + 1) & (stringSlots - 1);
+  if (stringTable[i].s == NULL)
+  { stringTable[i].s = s;
+    stringTable[i].offset = stringBytes;
+    stringTable[i].file = -1;
+    stringBytes += (uint32_t) strlen(s) + 1;
+  }
+  return &stringTable[i];
+}
+
+static int writeAll(FILE * f, const void * p, size_t n)
+{ return n == 0 || fwrite(p, 1, n, f) == n;
+}
+
+/* Function writeXref merges the symbols of the
+ * symbol table, found in source file file, into
+ * the index at path, creating it if need be; the
+ * entries of an earlier run on file are replaced.
+ * Returns FALSE if the index cannot be written.
+ */
+int writeXref(const char * path, const char * file)
+{ XrefIndex old;
+  Entry * entries;
+  XrefHeader h;
+  XrefSymbol * out;
+  uint32_t * files;
+  char * tmp;
+  FILE * f;
+  Symbol s;
+  long n = 0, max = 0, lineBytes = 0;
+  long i;
+  int ok;
+  mapIndex(path, &old);
+  if (old.base != NULL) max = old.header->symbols;
+  for (s = st_first(); s != NULL; s = st_next(s)) max++;
+  entries = (Entry *) malloc((max + 1) * sizeof(Entry));
+  if (entries == NULL)
+  { unmapIndex(&old);
+    return FALSE;
+  }
+  /* keep the entries of the other files */
+  if (old.base != NULL)
+    for (i = 0; i < old.header->symbols; i++)
+    { XrefSymbol * o = &old.symbols[i];
+      Entry * e = &entries[n];
+      e->file = old.strings + old.files[o->file];
+      if (strcmp(e->file, file) == 0) continue;
+      e->name = old.strings + o->name;
+      e->scope = old.strings + o->scope;
+      e->memloc = o->memloc;
+      e->decl = o->decl;
+      e->type = o->type;
+      e->lines = old.lines + o->lines;
+      e->lineBytes = (int) o->lineBytes;
+      e->line = o->line;
+      e->merged = NULL;
+      n++;
+    }
+  ok = TRUE;
+  for (s = st_first(); ok && s != NULL; s = st_next(s))
+  { Entry * e = &entries[n++];
+    e->name = st_name(s);
+    e->scope = st_scope(s);
+    e->file = file;
+    e->memloc = st_memloc(s);
+    e->decl = st_decl(s);
+    e->type = st_type(s);
+    ok = mergeLines(s, e);
+  }
+  if (ok) qsort(entries, n, sizeof(Entry), compareEntries);
+
+  /* lay out the strings, the files and the symbols */
+  stringSlots = 64;
+  while (stringSlots < 4 * (n + 1)) stringSlots *= 2;
+  stringTable = (StringSlot *) calloc(stringSlots, sizeof(StringSlot));
+  files = (uint32_t *) malloc((n + 1) * sizeof(uint32_t));
+  out = (XrefSymbol *) calloc(n + 1, sizeof(XrefSymbol));
+  if (!ok || stringTable == NULL || files == NULL || out == NULL)
+  { for (i = 0; i < n; i++) free(entries[i].merged);
+    free(stringTable);
+    free(files);
+    free(out);
+    free(entries);
+    unmapIndex(&old);
+    return FALSE;
+  }
+  stringBytes = 0;
+  fileCount = 0;
+  for (i = 0; i < n; i++)
+  { StringSlot * fs = stringSlot(entries[i].file);
+    if (fs->file < 0)
+    { fs->file = fileCount;
+      files[fileCount++] = fs->offset;
+    }
+    out[i].file = (uint32_t) fs->file;
+    out[i].name = stringSlot(entries[i].name)->offset;
+    out[i].scope = stringSlot(entries[i].scope)->offset;
+    out[i].memloc = entries[i].memloc;
+    out[i].line = entries[i].line;
+    out[i].decl = (uint8_t) entries[i].decl;
+    out[i].type = (uint8_t) entries[i].type;
+    out[i].lines = (uint32_t) lineBytes;
+    out[i].lineBytes = (uint32_t) entries[i].lineBytes;
+    lineBytes += entries[i].lineBytes;
+  }
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, XREF_MAGIC, 8);
+  h.version = XREF_VERSION;
+  h.files = (uint32_t) fileCount;
+  h.symbols = (uint32_t) n;
+  h.strings = stringBytes;
+  h.lines = (uint32_t) lineBytes;
+
+  /* write a new file and rename it over the old
+   * one, so that a reader never sees half an index
+   */
+  tmp = (char *) malloc(strlen(path) + 5);
+  sprintf(tmp, "%s.tmp", path);
+  f = fopen(tmp, "wb");
+  ok = f != NULL;
+  if (ok)
+  { char * strings = (char *) malloc(stringBytes + 1);
+    ok = strings != NULL;
+    if (ok)
+    { for (i = 0; i < stringSlots; i++)
+        if (stringTable[i].s != NULL)
+          strcpy(strings + stringTable[i].offset, stringTable[i].s);
+      ok = writeAll(f, &h, sizeof(h)) &&
+           writeAll(f, files, fileCount * sizeof(uint32_t)) &&
+           writeAll(f, out, n * sizeof(XrefSymbol)) &&
+           writeAll(f, strings, stringBytes);
+      for (i = 0; ok && i < n; i++)
+        ok = writeAll(f, entries[i].lines, entries[i].lineBytes);
+      free(strings);
+    }
+    ok = fclose(f) == 0 && ok;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) remove(tmp);
+  }
+  free(tmp);
+  for (i = 0; i < n; i++) free(entries[i].merged);
+  free(stringTable);
+  stringTable = NULL;
+  free(files);
+  free(out);
+  free(entries);
+  unmapIndex(&old);
+  return ok;
+}
+
+/* Function queryXref prints the definitions of
+ * name in the index at path, or, if refs is TRUE,
+ * every line that refers to it. Returns the number
+ * of lines printed, or -1 if the index cannot be
+ * read.
+ */
+int queryXref(const char * path, const char * name, int refs)
+{ XrefIndex x;
+  uint32_t lo, hi;
+  int printed = 0;
+  if (!mapIndex(path, &x)) return -1;
+  /* the first symbol not before name */
+  lo = 0;
+  hi = x.header->symbols;
+  while (lo < hi)
+  { uint32_t mid = lo + (hi - lo) / 2;
+    if (strcmp(x.strings + x.symbols[mid].name, name) < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  for (; lo < x.header->symbols &&
+         strcmp(x.strings + x.symbols[lo].name, name) == 0; lo++)
+  { XrefSymbol * s = &x.symbols[lo];
+    const char * file = x.strings + x.files[s->file];
+    const unsigned char * p = x.lines + s->lines;
+    int pos = 0, line = 0;
+    if (s->lineBytes == 0) continue;
+    if (refs)
+      while (pos < (int) s->lineBytes)
+      { line = nextLine(p, &pos, line);
+        fprintf(listing,"%s:%d: %s\n",file,line,name);
+        printed++;
+      }
+    else if (s->decl != 0)
+    { fprintf(listing,"%s:%d: %s %s %s in %s, location %d\n",file,s->line,
+              convertTypeToMessage(s->type),convertDeclToMessage(s->decl),
+              name,x.strings + s->scope,s->memloc);
+      printed++;
+    }
+  }
+  unmapIndex(&x);
+  return printed;
+}
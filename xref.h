@@ -0,0 +1,29 @@
+/****************************************************/
+/* File: xref.h                                     */
+/* Cross-reference index for the CMINUS compiler:   */
+/* the symbol tables of many source files in one    */
+/* file that is queried through mmap                */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _XREF_H_
+#define _XREF_H_
+
+/* Function writeXref merges the symbols of the
+ * symbol table, found in source file file, into
+ * the index at path, creating it if need be; the
+ * entries of an earlier run on file are replaced.
+ * Returns FALSE if the index cannot be written.
+ */
+int writeXref(const char * path, const char * file);
+
+/* Function queryXref prints the definitions of
+ * name in the index at path, or, if refs is TRUE,
+ * every line that refers to it. Returns the number
+ * of lines printed, or -1 if the index cannot be
+ * read.
+ */
+int queryXref(const char * path, const char * name, int refs);
+
+#endif